@@ -0,0 +1 @@
+g++ -O2 sphere_bench.cpp -o sphere_bench.out -lpthread
\ No newline at end of file
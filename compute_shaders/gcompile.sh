@@ -0,0 +1 @@
+g++ primitives.cpp ../src/glad.c -o primitives.out -lglfw -lGL -lX11 -lpthread -lXrandr -lXi -ldl
\ No newline at end of file
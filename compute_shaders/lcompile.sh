@@ -0,0 +1 @@
+g++ lifecycle.cpp ../src/glad.c -o lifecycle.out -lglfw -lGL -lX11 -lpthread -lXrandr -lXi -ldl
\ No newline at end of file
@@ -0,0 +1,477 @@
+#include "../include/glad/glad.h"
+#include "../include/shader.hpp"
+#include "../include/compute_shader.hpp"
+#include "../include/gpu_timer.hpp"
+#include "../include/indirect_dispatch.hpp"
+#include "../include/particle_storage.hpp"
+#include "../include/radix_sort.hpp"
+
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+// Particle system living entirely on the GPU: emitters take particles from a
+// dead list, the update pass ages them and moves the survivors to the next
+// alive list, and the alive particles are drawn with an indirect draw whose
+// count is written by the GPU. The CPU only uploads the emitters every frame.
+//
+// usage: lifecycle.out [--max N] [--rate R] [--half] [--sort] [--worst-case-dispatch]
+//     --max N    capacity of the particle pool (default 1000000)
+//     --rate R   particles emitted per second by each emitter (default 100000)
+//     --half     store velocities and colours as half floats
+//     --sort     sort the particles back to front every frame and alpha blend
+//                them instead of adding them up
+//     --worst-case-dispatch
+//                size the update pass for the whole pool instead of the alive
+//                count the GPU wrote, to compare
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void processInput(GLFWwindow *window);
+
+// settings
+const unsigned int SCR_WIDTH = 1280;
+const unsigned int SCR_HEIGHT = 720;
+
+
+// std430 layout of the Emitter struct in lifecycle.comp
+struct Emitter
+{
+    glm::vec4 position_radius;
+    glm::vec4 velocity_spread;
+    glm::vec4 color;
+    glm::vec2 lifetime;
+    GLuint first;
+    GLuint count;
+};
+static_assert(sizeof(Emitter) == 64, "Emitter must match its std430 layout");
+
+// an emitter and its emission rate, the fraction of a particle left over from
+// the previous frames is carried in pending
+struct EmitterState
+{
+    Emitter emitter;
+    float rate;
+    float pending;
+};
+
+// layout of counterBuffer in lifecycle.comp
+struct Counters
+{
+    GLint dead_count;
+    GLint alive_count[2];
+    GLint padding;
+    GLuint draw_count;
+    GLuint draw_instance_count;
+    GLuint draw_first;
+    GLuint draw_base_instance;
+};
+
+
+// Owns the particle pool, the dead and alive lists and the lifecycle passes
+class ParticleSystem
+{
+public:
+    ParticleSystem(unsigned int max_particles, particles::Precision precision = particles::FULL);
+    ~ParticleSystem();
+
+    // emits, ages and moves the particles, all on the GPU
+    void update(std::vector<EmitterState>& emitters, float dt);
+    // sorts the alive list back to front with a GPU radix sort of the view depths
+    void sort(const glm::mat4& view_projection, float near_depth, float far_depth);
+    // draws the alive particles with an indirect draw
+    void draw(const glm::mat4& view_projection);
+    // reads the alive counter back; stalls, for diagnostics only
+    int alive_count();
+
+    glm::vec3 gravity;
+    float drag;
+    // the update pass covers the alive list through an indirect dispatch,
+    // or the whole pool when false
+    bool indirect_update;
+
+    particles::ParticleStorage storage;
+
+private:
+    ComputeShader init_shader;
+    ComputeShader emit_shader;
+    ComputeShader update_shader;
+    ComputeShader finish_shader;
+    ComputeShader sort_key_shader;
+    Shader draw_shader;
+    RadixSort radix_sort;
+    IndirectDispatch update_dispatch;
+    unsigned int counter_buffer, dead_buffer, emitter_buffer, sort_key_buffer;
+    unsigned int alive_buffers[2];
+    unsigned int VAO;
+    unsigned int max_particles;
+    // alive list the next update reads
+    int current;
+    unsigned int frame;
+};
+
+
+ParticleSystem::ParticleSystem(unsigned int max_particles, particles::Precision precision) :
+    gravity(0.0f, -4.0f, 0.0f), drag(0.1f), indirect_update(true),
+    storage(max_particles, precision),
+    init_shader("shaders/lifecycle.comp", storage.glsl() + "#define INIT_PARTICLES"),
+    emit_shader("shaders/lifecycle.comp", storage.glsl() + "#define EMIT_PARTICLES"),
+    update_shader("shaders/lifecycle.comp", storage.glsl() + "#define UPDATE_PARTICLES"),
+    finish_shader("shaders/lifecycle.comp", storage.glsl() + "#define FINISH_FRAME"),
+    sort_key_shader("shaders/lifecycle.comp", storage.glsl() + "#define SORT_KEYS"),
+    draw_shader("shaders/lifecycle.vert", "shaders/lifecycle.frag", storage.glsl(), ""),
+    radix_sort(max_particles),
+    update_dispatch(),
+    max_particles(max_particles), current(0), frame(0)
+{
+    glGenBuffers(1, &this->counter_buffer);
+    glGenBuffers(1, &this->dead_buffer);
+    glGenBuffers(1, &this->emitter_buffer);
+    glGenBuffers(1, &this->sort_key_buffer);
+    glGenBuffers(2, this->alive_buffers);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->counter_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Counters), NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->dead_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t)max_particles * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->sort_key_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t)max_particles * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    for (int i = 0; i < 2; i++)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->alive_buffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t)max_particles * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    }
+
+    // points are generated from gl_VertexID, but core profile still wants a VAO bound
+    glGenVertexArrays(1, &this->VAO);
+
+    // every particle starts on the dead list
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, this->counter_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, this->dead_buffer);
+    this->init_shader.use();
+    this->init_shader.set_int("particleCount", max_particles);
+    glDispatchCompute((max_particles + 255) / 256, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+
+ParticleSystem::~ParticleSystem()
+{
+    glDeleteBuffers(1, &this->counter_buffer);
+    glDeleteBuffers(1, &this->dead_buffer);
+    glDeleteBuffers(1, &this->emitter_buffer);
+    glDeleteBuffers(1, &this->sort_key_buffer);
+    glDeleteBuffers(2, this->alive_buffers);
+    glDeleteVertexArrays(1, &this->VAO);
+    glDeleteProgram(this->init_shader.ID);
+    glDeleteProgram(this->emit_shader.ID);
+    glDeleteProgram(this->update_shader.ID);
+    glDeleteProgram(this->finish_shader.ID);
+    glDeleteProgram(this->sort_key_shader.ID);
+    glDeleteProgram(this->draw_shader.program_ID);
+}
+
+
+void ParticleSystem::update(std::vector<EmitterState>& emitters, float dt)
+{
+    // split this frame's emission between the emitters
+    std::vector<Emitter> gpu_emitters(emitters.size());
+    unsigned int emit_count = 0;
+    for (size_t e = 0; e < emitters.size(); e++)
+    {
+        EmitterState& state = emitters[e];
+        state.pending += state.rate * dt;
+        unsigned int count = (unsigned int)state.pending;
+        state.pending -= count;
+
+        gpu_emitters[e] = state.emitter;
+        gpu_emitters[e].first = emit_count;
+        gpu_emitters[e].count = count;
+        emit_count += count;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->emitter_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, gpu_emitters.size() * sizeof(Emitter), gpu_emitters.data(), GL_STREAM_DRAW);
+
+    this->storage.bind();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, this->counter_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, this->dead_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, this->alive_buffers[this->current]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, this->alive_buffers[1 - this->current]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, this->emitter_buffer);
+
+    // emit
+    if (emit_count > 0)
+    {
+        this->emit_shader.use();
+        this->emit_shader.set_int("current", this->current);
+        this->emit_shader.set_int("emitCount", emit_count);
+        this->emit_shader.set_int("emitterCount", gpu_emitters.size());
+        this->emit_shader.set_int("frame", this->frame);
+        glDispatchCompute((emit_count + 255) / 256, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    // update: the alive count is only known on the GPU, the dispatch is sized
+    // from it there; the invocations past the end of the list return
+    if (this->indirect_update)
+    {
+        int alive_index = offsetof(Counters, alive_count) / sizeof(GLint) + this->current;
+        this->update_dispatch.build(this->counter_buffer, alive_index, 256);
+        // build() takes binding points 0 and 1
+        this->storage.bind();
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, this->counter_buffer);
+    }
+    this->update_shader.use();
+    this->update_shader.set_int("current", this->current);
+    this->update_shader.set_float("dt", dt);
+    this->update_shader.set_vec3("gravity", this->gravity);
+    this->update_shader.set_float("drag", this->drag);
+    if (this->indirect_update)
+        this->update_dispatch.dispatch(this->update_shader);
+    else
+        glDispatchCompute((this->max_particles + 255) / 256, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    this->finish_shader.use();
+    this->finish_shader.set_int("current", this->current);
+    glDispatchCompute(1, 1, 1);
+    // the draw reads the command and the lists written above
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // the survivors are the current list of the next frame
+    this->current = 1 - this->current;
+    this->frame++;
+}
+
+
+void ParticleSystem::sort(const glm::mat4& view_projection, float near_depth, float far_depth)
+{
+    // the alive count is only known on the GPU: sort the whole pool, the
+    // entries past the end of the list have the largest key and stay there
+    this->storage.bind();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, this->counter_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, this->alive_buffers[this->current]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, this->sort_key_buffer);
+    this->sort_key_shader.use();
+    this->sort_key_shader.set_int("particleCount", this->max_particles);
+    this->sort_key_shader.set_mat4("viewProjection", view_projection);
+    this->sort_key_shader.set_vec2("depthRange", near_depth, far_depth);
+    glDispatchCompute((this->max_particles + 255) / 256, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // the alive list itself is the payload
+    this->radix_sort.sort(this->sort_key_buffer, this->alive_buffers[this->current], this->max_particles, 16);
+}
+
+
+void ParticleSystem::draw(const glm::mat4& view_projection)
+{
+    this->storage.bind();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, this->alive_buffers[this->current]);
+
+    this->draw_shader.use();
+    this->draw_shader.set_mat4("viewProjection", view_projection);
+
+    glBindVertexArray(this->VAO);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->counter_buffer);
+    glDrawArraysIndirect(GL_POINTS, (void*)offsetof(Counters, draw_count));
+    glBindVertexArray(0);
+}
+
+
+int ParticleSystem::alive_count()
+{
+    GLint count = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->counter_buffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, offsetof(Counters, alive_count) + this->current * sizeof(GLint),
+        sizeof(GLint), &count);
+    return count;
+}
+
+
+int main(int argc, char* argv[])
+{
+    unsigned int maxParticles = 1000000;
+    float rate = 100000.0f;
+    particles::Precision precision = particles::FULL;
+    bool sortParticles = false;
+    bool worstCaseDispatch = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--max" && i + 1 < argc)
+            maxParticles = std::stoul(argv[++i]);
+        else if (arg == "--rate" && i + 1 < argc)
+            rate = std::stof(argv[++i]);
+        else if (arg == "--half")
+            precision = particles::HALF;
+        else if (arg == "--sort")
+            sortParticles = true;
+        else if (arg == "--worst-case-dispatch")
+            worstCaseDispatch = true;
+    }
+
+    // glfw: initialize and configure
+    // ------------------------------
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+    // glfw window creation
+    // --------------------
+    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+    if (window == NULL)
+    {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSwapInterval(0);
+
+    // glad: load all OpenGL function pointers
+    // ---------------------------------------
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return -1;
+    }
+
+    // configure global opengl state
+    // -----------------------------
+    // particles are additive glowing points, no depth needed; sorted back to
+    // front they can be alpha blended instead
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, sortParticles ? GL_ONE_MINUS_SRC_ALPHA : GL_ONE);
+    glPointSize(2.0f);
+
+    // three fountains
+    std::vector<EmitterState> emitters;
+    const glm::vec4 colors[3] = {
+        glm::vec4(1.0f, 0.5f, 0.1f, 0.5f),
+        glm::vec4(0.2f, 0.6f, 1.0f, 0.5f),
+        glm::vec4(0.3f, 1.0f, 0.4f, 0.5f),
+    };
+    for (int e = 0; e < 3; e++)
+    {
+        EmitterState state;
+        state.emitter.position_radius = glm::vec4(-3.0f + 3.0f * e, 0.0f, 0.0f, 0.1f);
+        state.emitter.velocity_spread = glm::vec4(0.0f, 6.0f, 0.0f, 1.5f);
+        state.emitter.color = colors[e];
+        state.emitter.lifetime = glm::vec2(2.0f, 4.0f);
+        state.emitter.first = 0;
+        state.emitter.count = 0;
+        state.rate = rate;
+        state.pending = 0.0f;
+        emitters.push_back(state);
+    }
+
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 3.0f, 12.0f), glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const float nearPlane = 0.1f;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, nearPlane, 100.0f);
+
+    // the particle system owns GL objects, it has to be gone before the context is destroyed
+    {
+        ParticleSystem system(maxParticles, precision);
+        system.indirect_update = !worstCaseDispatch;
+        std::cout << system.storage.bytes_per_particle() << " bytes per particle, "
+            << maxParticles * system.storage.bytes_per_particle() / (1024 * 1024) << " MB of particle storage" << std::endl;
+        GpuTimer timer;
+        GpuTimer sortTimer;
+
+        // timing
+        float deltaTime = 0.0f; // time between current frame and last frame
+        float lastFrame = glfwGetTime(); // time of last frame
+        int fCounter = 0;
+
+        // render loop
+        // -----------
+        while (!glfwWindowShouldClose(window))
+        {
+            float currentFrame = glfwGetTime();
+            deltaTime = currentFrame - lastFrame;
+            lastFrame = currentFrame;
+            if (fCounter > 500)
+            {
+                std::cout << "FPS: " << 1 / deltaTime << ", simulation: " << timer.elapsed_ms() << " ms";
+                if (sortParticles)
+                    std::cout << ", sort: " << sortTimer.elapsed_ms() << " ms";
+                std::cout << ", alive: " << system.alive_count() << std::endl;
+                fCounter = 0;
+            }
+            else
+            {
+                fCounter++;
+            }
+
+            // input
+            // -----
+            processInput(window);
+
+            // the fountains sway from side to side
+            for (size_t e = 0; e < emitters.size(); e++)
+                emitters[e].emitter.velocity_spread.x = 1.5f * std::sin(currentFrame + 2.0f * e);
+
+            // long frames (window drags) would emit and move everything at once
+            float dt = std::min(deltaTime, 0.05f);
+            timer.begin();
+            system.update(emitters, dt);
+            timer.end();
+            if (sortParticles)
+            {
+                sortTimer.begin();
+                // the fountains stay within 30 units of the camera, keep the 16 bit keys for that range
+                system.sort(projection * view, nearPlane, 30.0f);
+                sortTimer.end();
+            }
+
+            // render
+            // ------
+            glClearColor(0.02f, 0.02f, 0.03f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            system.draw(projection * view);
+
+            // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+            // -------------------------------------------------------------------------------
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+    }
+
+    // glfw: terminate, clearing all previously allocated GLFW resources.
+    // ------------------------------------------------------------------
+    glfwTerminate();
+    return 0;
+}
+
+// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
+// ---------------------------------------------------------------------------------------------------------
+void processInput(GLFWwindow *window)
+{
+    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+        glfwSetWindowShouldClose(window, true);
+}
+
+// glfw: whenever the window size changed (by OS or user resize) this callback function executes
+// ---------------------------------------------------------------------------------------------
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+    // make sure the viewport matches the new window dimensions; note that width and
+    // height will be significantly larger than specified on retina displays.
+    glViewport(0, 0, width, height);
+}
@@ -1,6 +1,16 @@
 #include "../include/glad/glad.h"
+#include "../include/async_readback.hpp"
+#include "../include/auto_exposure.hpp"
 #include "../include/shader.hpp"
 #include "../include/compute_shader.hpp"
+#include "../include/frame_capture.hpp"
+#include "../include/gpu_timer.hpp"
+#include "../include/image_filters.hpp"
+#include "../include/image_format.hpp"
+#include "../include/pass_graph.hpp"
+#include "../include/ping_pong.hpp"
+#include "../include/primitives.hpp"
+#include "../include/workgroup_tuner.hpp"
 
 
 #include <GLFW/glfw3.h>
@@ -9,7 +19,11 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <string>
+#include <vector>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
@@ -26,19 +40,12 @@ void renderQuad()
 {
 	if (quadVAO == 0)
 	{
-		float quadVertices[] = {
-			// positions        // texture Coords
-			-1.0f,  1.0f, 0.0f, 0.0f, 1.0f,
-			-1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
-			 1.0f,  1.0f, 0.0f, 1.0f, 1.0f,
-			 1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
-		};
 		// setup plane VAO
 		glGenVertexArrays(1, &quadVAO);
 		glGenBuffers(1, &quadVBO);
 		glBindVertexArray(quadVAO);
 		glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(primitives::QUAD), primitives::QUAD.data(), GL_STATIC_DRAW);
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
 		glEnableVertexAttribArray(1);
@@ -50,14 +57,323 @@ void renderQuad()
 }
 
 
-int main()
+/**
+ * @brief Times the compute shader writing to an image of every format and
+ * reports the dispatch time, the write bandwidth and how far the stored
+ * values are from the rgba32f ones.
+ *
+ * @param dispatches dispatches timed per format
+ */
+void benchmark_formats(int dispatches)
 {
+    std::vector<float> reference;
+    std::vector<float> texels((size_t)TEXTURE_WIDTH * TEXTURE_HEIGHT * 4);
+    GpuTimer timer;
+
+    std::cout << TEXTURE_WIDTH << "x" << TEXTURE_HEIGHT << " image, " << dispatches << " dispatches" << std::endl;
+    // rgba32f last, it is the reference
+    for (int f = image_format::FORMAT_COUNT - 1; f >= 0; f--)
+    {
+        const image_format::ImageFormat& format = image_format::FORMATS[f];
+        ComputeShader computeShader("shaders/shader.comp", image_format::glsl(format));
+
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        // no mipmaps: the default min filter would leave the texture incomplete
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        image_format::allocate(format, TEXTURE_WIDTH, TEXTURE_HEIGHT);
+        glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, format.internal_format);
+
+        computeShader.use();
+        computeShader.set_float("t", 1.0f);
+        // warm up, the first dispatch pays for allocating the storage
+        glDispatchCompute(TEXTURE_WIDTH / 10, TEXTURE_HEIGHT / 10, 1);
+        timer.begin();
+        for (int i = 0; i < dispatches; i++)
+            glDispatchCompute(TEXTURE_WIDTH / 10, TEXTURE_HEIGHT / 10, 1);
+        timer.end();
+        double ms = timer.elapsed_ms() / dispatches;
+        double gbs = (double)TEXTURE_WIDTH * TEXTURE_HEIGHT * format.bytes_per_texel / (ms * 1e6);
+
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, texels.data());
+        if (reference.empty())
+            reference = texels;
+        // the shader writes rg, b and a are constants
+        float maxError = 0.0f;
+        for (size_t i = 0; i < texels.size(); i += 4)
+            maxError = std::max({ maxError, std::abs(texels[i] - reference[i]),
+                std::abs(texels[i + 1] - reference[i + 1]) });
+
+        std::cout << "  " << format.name << ": " << ms << " ms/dispatch, " << gbs << " GB/s written, max error "
+            << maxError << std::endl;
+
+        glDeleteTextures(1, &texture);
+        glDeleteProgram(computeShader.ID);
+    }
+}
+
+
+/**
+ * @brief Times steps of the diffusion stencil on a 4096x4096 ping-pong pair of
+ * every format and reports the time per step, the cells updated per second and
+ * the bandwidth of one read and one write per cell.
+ *
+ * @param steps steps timed per format
+ */
+void benchmark_diffusion(int steps)
+{
+    const int size = 4096;
+    const LocalSize localSize = { 16, 16, 1 };
+    GpuTimer timer;
+
+    std::cout << size << "x" << size << " diffusion, " << steps << " steps" << std::endl;
+    for (const image_format::ImageFormat& format : image_format::FORMATS)
+    {
+        std::string defines = image_format::glsl(format) + WorkgroupTuner::glsl(localSize);
+        ComputeShader seedShader("shaders/diffusion.comp", defines + "#define DIFFUSION_SEED\n");
+        ComputeShader stepShader("shaders/diffusion.comp", defines);
+        PingPongTexture state(size, size, format);
+        unsigned int groups = WorkgroupTuner::groups(size, localSize.x);
+
+        state.iterate(1, [&](int) {
+            seedShader.use();
+            glDispatchCompute(groups, groups, 1);
+        });
+        stepShader.use();
+        stepShader.set_float("rate", 0.2f);
+        auto step = [&](int i) {
+            stepShader.set_float("t", 0.01f * i);
+            glDispatchCompute(groups, groups, 1);
+        };
+        // warm up
+        state.iterate(2, step);
+        timer.begin();
+        state.iterate(steps, step);
+        timer.end();
+        double ms = timer.elapsed_ms() / steps;
+        double cells = (double)size * size;
+
+        std::cout << "  " << format.name << ": " << ms << " ms/step, " << cells / (ms * 1e6) << " Gcells/s, "
+            << 2.0 * cells * format.bytes_per_texel / (ms * 1e6) << " GB/s" << std::endl;
+
+        glDeleteProgram(seedShader.ID);
+        glDeleteProgram(stepShader.ID);
+    }
+}
+
+
+// filters --filter accepts, see apply_filter
+const char* FILTER_NAMES[] = { "gaussian", "box", "sobel", "sharpen", "blur5" };
+
+
+/**
+ * @brief Runs one of FILTER_NAMES from source to destination.
+ *
+ * @param filters
+ * @param name
+ * @param scratch holds the rows pass of the separable filters
+ * @return the image passes it took, 0 for an unknown name
+ */
+int apply_filter(ImageFilters& filters, const std::string& name, unsigned int source, unsigned int scratch,
+    unsigned int destination, int width, int height)
+{
+    if (name == "gaussian")
+    {
+        filters.gaussian(source, scratch, destination, width, height, 2.0f);
+        return 2;
+    }
+    if (name == "box")
+    {
+        filters.box(source, scratch, destination, width, height, 4);
+        return 2;
+    }
+    if (name == "sobel")
+    {
+        filters.sobel(source, destination, width, height);
+        return 1;
+    }
+    if (name == "sharpen")
+    {
+        filters.convolve(source, destination, width, height, {
+             0.0f, -1.0f,  0.0f,
+            -1.0f,  5.0f, -1.0f,
+             0.0f, -1.0f,  0.0f });
+        return 1;
+    }
+    if (name == "blur5")
+    {
+        // binomial, 1 4 6 4 1 squared over 256
+        std::vector<float> kernel(25);
+        const float row[5] = { 1.0f, 4.0f, 6.0f, 4.0f, 1.0f };
+        for (int y = 0; y < 5; y++)
+            for (int x = 0; x < 5; x++)
+                kernel[y * 5 + x] = row[y] * row[x] / 256.0f;
+        filters.convolve(source, destination, width, height, kernel);
+        return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Times every filter on a 4096x4096 image with the tiled kernels and with
+ * the ones doing an imageLoad per tap, and reports the time per filter, the
+ * bandwidth of one read and one write per texel and pass, and the largest
+ * difference between the two outputs.
+ *
+ * @param format format of the images
+ * @param repetitions runs timed per filter and kernel
+ */
+void benchmark_filters(const image_format::ImageFormat& format, int repetitions)
+{
+    const int size = 4096;
+    const size_t texels = (size_t)size * size;
+    GpuTimer timer;
+
+    // source, scratch, destination
+    unsigned int textures[3];
+    glGenTextures(3, textures);
+    for (unsigned int texture : textures)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        // no mipmaps: the default min filter would leave the texture incomplete
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        image_format::allocate(format, size, size);
+    }
+    ComputeShader sourceShader("shaders/shader.comp", image_format::glsl(format));
+    sourceShader.use();
+    sourceShader.set_float("t", 1.0f);
+    glBindImageTexture(0, textures[0], 0, GL_FALSE, 0, GL_WRITE_ONLY, format.internal_format);
+    glDispatchCompute(size / 10 + 1, size / 10 + 1, 1);
+    glDeleteProgram(sourceShader.ID);
+
+    ImageFilters naive(format, false);
+    ImageFilters tiled(format, true);
+    std::vector<float> naiveTexels(texels * 4), tiledTexels(texels * 4);
+
+    std::cout << size << "x" << size << " " << format.name << ", " << repetitions << " runs" << std::endl;
+    for (const char* name : FILTER_NAMES)
+    {
+        double ms[2];
+        int passes = 0;
+        for (int k = 0; k < 2; k++)
+        {
+            ImageFilters& filters = k == 0 ? naive : tiled;
+            auto run = [&] {
+                glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+                passes = apply_filter(filters, name, textures[0], textures[1], textures[2], size, size);
+            };
+            // warm up, compiles the variant
+            run();
+            timer.begin();
+            for (int i = 0; i < repetitions; i++)
+                run();
+            timer.end();
+            ms[k] = timer.elapsed_ms() / repetitions;
+
+            glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+            glBindTexture(GL_TEXTURE_2D, textures[2]);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, k == 0 ? naiveTexels.data() : tiledTexels.data());
+        }
+        float maxError = 0.0f;
+        for (size_t i = 0; i < naiveTexels.size(); i++)
+            maxError = std::max(maxError, std::abs(naiveTexels[i] - tiledTexels[i]));
+        double bytes = 2.0 * texels * format.bytes_per_texel * passes;
+
+        std::cout << "  " << name << ": naive " << ms[0] << " ms (" << bytes / (ms[0] * 1e6) << " GB/s), tiled "
+            << ms[1] << " ms (" << bytes / (ms[1] * 1e6) << " GB/s), " << ms[0] / ms[1] << "x, max difference "
+            << maxError << std::endl;
+    }
+
+    glDeleteTextures(3, textures);
+}
+
+
+int main(int argc, char* argv[])
+{
+    // copies the image back every frame without waiting on the GPU and prints
+    // its mean colour with the FPS
+    bool readback = false;
+    // records the window to a .y4m or raw RGBA file, "-" for stdout; the
+    // animation then advances 1 / captureFps per frame so the video plays at
+    // the speed it was meant to whatever the frame rate
+    std::string capturePath;
+    int captureFps = 60;
+    // storage of the output image, see image_format::FORMATS
+    std::string formatName = "rgba32f";
+    // times every format and exits
+    int benchmarkDispatches = 0;
+    // picks the work group shape of shader.comp, cached in workgroup_sizes.txt
+    bool tune = false;
+    // prints the barriers the pass graph placed on exit
+    bool barrierReport = false;
+    // runs a diffusion simulation with this many steps per frame instead of
+    // the animated gradient, 0 for the gradient
+    int diffusionSteps = 0;
+    // times the diffusion at 4096x4096 and exits
+    bool benchmarkDiffusion = false;
+    // post-processes the image with one of FILTER_NAMES before showing it
+    std::string filterName;
+    // times the tiled filters against naive ones at 4096x4096 and exits
+    bool benchmarkFilters = false;
+    // exposes and tone maps the image for its mean luminance, measured and
+    // adapted on the GPU
+    bool autoExposure = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--readback")
+            readback = true;
+        else if (arg == "--capture" && i + 1 < argc)
+            capturePath = argv[++i];
+        else if (arg == "--capture-fps" && i + 1 < argc)
+            captureFps = std::stoi(argv[++i]);
+        else if (arg == "--image-format" && i + 1 < argc)
+            formatName = argv[++i];
+        else if (arg == "--benchmark-formats")
+            benchmarkDispatches = 200;
+        else if (arg == "--tune")
+            tune = true;
+        else if (arg == "--barrier-report")
+            barrierReport = true;
+        else if (arg == "--diffuse" && i + 1 < argc)
+            diffusionSteps = std::stoi(argv[++i]);
+        else if (arg == "--benchmark-diffusion")
+            benchmarkDiffusion = true;
+        else if (arg == "--filter" && i + 1 < argc)
+            filterName = argv[++i];
+        else if (arg == "--benchmark-filters")
+            benchmarkFilters = true;
+        else if (arg == "--auto-exposure")
+            autoExposure = true;
+    }
+    const image_format::ImageFormat* imageFormat = image_format::find(formatName);
+    if (imageFormat == nullptr)
+        return -1;
+    if (!filterName.empty() && std::none_of(std::begin(FILTER_NAMES), std::end(FILTER_NAMES),
+        [&](const char* name) { return filterName == name; }))
+    {
+        std::cout << "ERROR::FILTER::UNKNOWN_FILTER: " << filterName << std::endl;
+        return -1;
+    }
+    // the video owns stdout, the console output goes to stderr
+    std::streambuf* coutBuffer = std::cout.rdbuf();
+    if (capturePath == "-")
+        std::cout.rdbuf(std::cerr.rdbuf());
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    // the capture size is fixed when the capture starts
+    if (!capturePath.empty())
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
@@ -112,8 +428,26 @@ int main()
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
 
-    Shader screenQuad("shaders/shader.vs", "shaders/shader.fs");
-    ComputeShader computeShader("shaders/shader.comp");
+    if (benchmarkDispatches > 0)
+    {
+        benchmark_formats(benchmarkDispatches);
+        glfwTerminate();
+        return 0;
+    }
+    if (benchmarkDiffusion)
+    {
+        benchmark_diffusion(100);
+        glfwTerminate();
+        return 0;
+    }
+    if (benchmarkFilters)
+    {
+        benchmark_filters(*imageFormat, 50);
+        glfwTerminate();
+        return 0;
+    }
+
+    Shader screenQuad("shaders/shader.vs", "shaders/shader.fs", autoExposure ? "#define TONE_MAP\n" : "");
     
     // texture 
     unsigned int texture;
@@ -125,10 +459,145 @@ int main()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, TEXTURE_WIDTH, TEXTURE_HEIGHT, 0, GL_RGBA, 
-                GL_FLOAT, NULL);
+    image_format::allocate(*imageFormat, TEXTURE_WIDTH, TEXTURE_HEIGHT);
 
-    glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_READ_WRITE, imageFormat->internal_format);
+
+    LocalSize localSize = { 10, 10, 1 };
+    if (tune)
+    {
+        WorkgroupTuner tuner;
+        localSize = tuner.tune(std::string("shader.comp ") + imageFormat->name + " "
+            + std::to_string(TEXTURE_WIDTH) + "x" + std::to_string(TEXTURE_HEIGHT),
+            "shaders/shader.comp", image_format::glsl(*imageFormat), WorkgroupTuner::candidates_2d(),
+            [](ComputeShader& shader, const LocalSize& size) {
+                shader.use();
+                shader.set_float("t", 0.0f);
+                glDispatchCompute(WorkgroupTuner::groups(TEXTURE_WIDTH, size.x),
+                    WorkgroupTuner::groups(TEXTURE_HEIGHT, size.y), 1);
+            });
+        std::cout << "work group " << localSize.x << "x" << localSize.y << std::endl;
+    }
+    ComputeShader computeShader("shaders/shader.comp",
+        image_format::glsl(*imageFormat) + WorkgroupTuner::glsl(localSize));
+
+    // the diffusion reads its neighbours, so it steps between two images
+    // instead of updating one in place
+    PingPongTexture* diffusion = nullptr;
+    ComputeShader* diffusionShader = nullptr;
+    const LocalSize diffusionLocalSize = { 16, 16, 1 };
+    if (diffusionSteps > 0)
+    {
+        std::string defines = image_format::glsl(*imageFormat) + WorkgroupTuner::glsl(diffusionLocalSize);
+        diffusion = new PingPongTexture(TEXTURE_WIDTH, TEXTURE_HEIGHT, *imageFormat);
+        diffusionShader = new ComputeShader("shaders/diffusion.comp", defines);
+        ComputeShader seedShader("shaders/diffusion.comp", defines + "#define DIFFUSION_SEED\n");
+        diffusion->iterate(1, [&](int) {
+            seedShader.use();
+            glDispatchCompute(WorkgroupTuner::groups(TEXTURE_WIDTH, diffusionLocalSize.x),
+                WorkgroupTuner::groups(TEXTURE_HEIGHT, diffusionLocalSize.y), 1);
+        });
+        glDeleteProgram(seedShader.ID);
+    }
+    // the filtered image, and the one between the two passes of the separable filters
+    ImageFilters* filters = nullptr;
+    unsigned int filterTextures[2];
+    if (!filterName.empty())
+    {
+        filters = new ImageFilters(*imageFormat);
+        glGenTextures(2, filterTextures);
+        for (unsigned int filterTexture : filterTextures)
+        {
+            glBindTexture(GL_TEXTURE_2D, filterTexture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            image_format::allocate(*imageFormat, TEXTURE_WIDTH, TEXTURE_HEIGHT);
+        }
+    }
+    AutoExposure* exposure = nullptr;
+    if (autoExposure)
+        exposure = new AutoExposure(*imageFormat);
+    // image the readback and the quad show
+    unsigned int displayTexture = filters != nullptr ? filterTextures[0]
+        : diffusion != nullptr ? diffusion->read() : texture;
+
+    const size_t imageBytes = (size_t)TEXTURE_WIDTH * TEXTURE_HEIGHT * 4 * sizeof(float);
+    AsyncReadback* imageReadback = nullptr;
+    if (readback)
+        imageReadback = new AsyncReadback(imageBytes);
+    // frames rendered, tags the readbacks to measure their latency
+    uint64_t frameIndex = 0;
+    float meanColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    uint64_t readbackLatency = 0;
+
+    FrameCapture* capture = nullptr;
+    if (!capturePath.empty())
+    {
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        capture = new FrameCapture(capturePath, width, height, captureFps);
+    }
+
+    // the passes of a frame, with the barriers between them placed from what
+    // each one reads and writes
+    pass_graph::PassGraph graph;
+    int imageResource = graph.resource("imgOutput");
+    int filterResource = graph.resource("filtered");
+    int exposureResource = graph.resource("exposure");
+    float frameTime = 0.0f;
+    float frameDelta = 0.0f;
+    int computePass = graph.add_pass("compute", { pass_graph::write(imageResource, pass_graph::SHADER_IMAGE) }, [&] {
+        if (diffusion != nullptr)
+        {
+            diffusionShader->use();
+            diffusionShader->set_float("rate", 0.2f);
+            diffusion->iterate(diffusionSteps, [&](int) {
+                diffusionShader->set_float("t", frameTime);
+                glDispatchCompute(WorkgroupTuner::groups(TEXTURE_WIDTH, diffusionLocalSize.x),
+                    WorkgroupTuner::groups(TEXTURE_HEIGHT, diffusionLocalSize.y), 1);
+            });
+            if (filters == nullptr)
+                displayTexture = diffusion->read();
+            return;
+        }
+        // the filters bind their own images to unit 0
+        glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_READ_WRITE, imageFormat->internal_format);
+        computeShader.use();
+        computeShader.set_float("t", frameTime);
+        glDispatchCompute(WorkgroupTuner::groups(TEXTURE_WIDTH, localSize.x),
+            WorkgroupTuner::groups(TEXTURE_HEIGHT, localSize.y), 1);
+    });
+    int filterPass = graph.add_pass("filter", { pass_graph::read(imageResource, pass_graph::SHADER_IMAGE),
+        pass_graph::write(filterResource, pass_graph::SHADER_IMAGE) }, [&] {
+        unsigned int source = diffusion != nullptr ? diffusion->read() : texture;
+        apply_filter(*filters, filterName, source, filterTextures[1], filterTextures[0], TEXTURE_WIDTH, TEXTURE_HEIGHT);
+    });
+    // the adaptation reads and clears the histogram of the previous frame
+    int exposurePass = graph.add_pass("exposure", { pass_graph::read(imageResource, pass_graph::SHADER_IMAGE),
+        pass_graph::read(filterResource, pass_graph::SHADER_IMAGE),
+        pass_graph::read_write(exposureResource, pass_graph::SHADER_STORAGE) }, [&] {
+        exposure->update(displayTexture, TEXTURE_WIDTH, TEXTURE_HEIGHT, frameDelta);
+    });
+    int readbackPass = graph.add_pass("readback", { pass_graph::read(imageResource, pass_graph::TEXTURE_UPDATE),
+        pass_graph::read(filterResource, pass_graph::TEXTURE_UPDATE) }, [&] {
+        // frames are skipped while the ring is full, never waited for
+        imageReadback->read_texture(displayTexture, GL_TEXTURE_2D, GL_RGBA, GL_FLOAT, imageBytes, frameIndex);
+    });
+    int drawPass = graph.add_pass("draw", { pass_graph::read(imageResource, pass_graph::TEXTURE_FETCH),
+        pass_graph::read(filterResource, pass_graph::TEXTURE_FETCH),
+        pass_graph::read(exposureResource, pass_graph::SHADER_STORAGE) }, [&] {
+        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        screenQuad.use();
+        screenQuad.set_int("tex", 0);
+        if (exposure != nullptr)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, exposure->exposure_buffer());
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, displayTexture);
+        renderQuad();
+    });
 
     // timing 
     float deltaTime = 0.0f; // time between current frame and last frame
@@ -145,7 +614,11 @@ int main()
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
         if(fCounter > 500) {
-                std::cout << "FPS: " << 1 / deltaTime << std::endl;
+                std::cout << "FPS: " << 1 / deltaTime;
+                if (imageReadback != nullptr)
+                    std::cout << ", mean colour: (" << meanColor[0] << ", " << meanColor[1] << ", "
+                        << meanColor[2] << ") " << readbackLatency << " frames late";
+                std::cout << std::endl;
                 fCounter = 0;
         } else {
             fCounter++;
@@ -155,26 +628,37 @@ int main()
         processInput(window);
 
         // compute shader
-        computeShader.use();
-        computeShader.set_float("t", currentFrame);
-        glDispatchCompute((unsigned int)TEXTURE_WIDTH/10, (unsigned int)TEXTURE_HEIGHT/10, 1);
-    
-        // make sure writing to image has finished before read
-        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-
-        // render
-        // ------
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // also clear the depth buffer now!
+        frameTime = capture != nullptr ? (float)frameIndex / captureFps : currentFrame;
+        frameDelta = capture != nullptr ? 1.0f / captureFps : deltaTime;
+        graph.run(computePass);
+        if (filters != nullptr)
+            graph.run(filterPass);
+        if (exposure != nullptr)
+            graph.run(exposurePass);
+
+        if (imageReadback != nullptr)
+        {
+            graph.run(readbackPass);
+            Span span;
+            if (imageReadback->poll(span))
+            {
+                const float* texels = span.as<float>();
+                double sum[4] = { 0.0, 0.0, 0.0, 0.0 };
+                for (size_t i = 0; i < span.count<float>(); i++)
+                    sum[i % 4] += texels[i];
+                for (int c = 0; c < 4; c++)
+                    meanColor[c] = (float)(sum[c] / (TEXTURE_WIDTH * TEXTURE_HEIGHT));
+                readbackLatency = frameIndex - span.tag;
+                imageReadback->release(span);
+            }
+        }
+        frameIndex++;
 
         // render image to quad
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        screenQuad.use();
-        screenQuad.set_int("tex", 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        renderQuad();
-
+        // --------------------
+        graph.run(drawPass);
+        if (capture != nullptr)
+            capture->capture();
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
@@ -182,7 +666,19 @@ int main()
         glfwPollEvents();
     }
 
-
+    if (barrierReport)
+        graph.report();
+    delete imageReadback;
+    delete diffusion;
+    if (diffusionShader != nullptr)
+        glDeleteProgram(diffusionShader->ID);
+    delete diffusionShader;
+    if (filters != nullptr)
+        glDeleteTextures(2, filterTextures);
+    delete filters;
+    delete exposure;
+    delete capture;
+    std::cout.rdbuf(coutBuffer);
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -0,0 +1,275 @@
+#include "../include/glad/glad.h"
+#include "../include/compute_shader.hpp"
+#include "../include/gpu_timer.hpp"
+#include "../include/ping_pong.hpp"
+#include "../include/prefix_scan.hpp"
+#include "../include/reduction.hpp"
+#include "../include/stream_compaction.hpp"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+// Checks the GPU scan, reduction, stream compaction and ping-pong buffers
+// against their CPU references on awkward sizes, then measures their throughput in GB/s. Runs in
+// a hidden window and exits with 1 if any check failed.
+//
+// usage: primitives.out [--count N] [--runs N]
+//     --count N  values per benchmark (default 16777216)
+//     --runs N   runs timed per benchmark (default 20)
+
+// sizes around the block boundaries and one needing three scan levels
+const unsigned int CHECK_SIZES[] = { 1, 2, 255, 511, 512, 513, 1000, 262144, 262145, 1000003 };
+
+
+unsigned int upload(const void* data, size_t bytes)
+{
+    unsigned int buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(bytes, (size_t)4), data, GL_DYNAMIC_COPY);
+    return buffer;
+}
+
+
+std::vector<unsigned int> download(unsigned int buffer, size_t count)
+{
+    std::vector<unsigned int> values(count);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(GLuint), values.data());
+    return values;
+}
+
+
+/**
+ * @brief Prints and returns whether one check passed.
+ *
+ * @param name primitive and size checked
+ * @param ok
+ * @return ok
+ */
+bool report(const std::string& name, bool ok)
+{
+    std::cout << "  " << name << (ok ? ": ok" : ": MISMATCH") << std::endl;
+    return ok;
+}
+
+
+/**
+ * @brief Runs every primitive on random values of every CHECK_SIZES and
+ * compares it with the CPU version.
+ *
+ * @return true if all of them matched
+ */
+bool check_primitives(std::mt19937& random)
+{
+    const unsigned int capacity = *std::max_element(std::begin(CHECK_SIZES), std::end(CHECK_SIZES));
+    PrefixScan scan(capacity);
+    Reduction reduction(capacity);
+    StreamCompaction compaction(capacity);
+    bool ok = true;
+
+    std::cout << "checks:" << std::endl;
+    for (unsigned int count : CHECK_SIZES)
+    {
+        std::string suffix = " " + std::to_string(count);
+        std::vector<unsigned int> values(count), flags(count);
+        std::vector<int> ints(count);
+        std::vector<float> floats(count);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            values[i] = random() % 1000;
+            flags[i] = random() % 3 == 0 ? random() : 0;
+            ints[i] = (int)(random() % 2000001) - 1000000;
+            floats[i] = std::uniform_real_distribution<float>(-1.0f, 1.0f)(random);
+        }
+
+        unsigned int buffer = upload(values.data(), count * sizeof(GLuint));
+        scan.exclusive_scan(buffer, count);
+        ok &= report("exclusive scan" + suffix, download(buffer, count) == PrefixScan::reference(values));
+        glDeleteBuffers(1, &buffer);
+
+        buffer = upload(values.data(), count * sizeof(GLuint));
+        for (Reduction::Op op : { Reduction::SUM, Reduction::MIN, Reduction::MAX })
+        {
+            const char* names[] = { " sum", " min", " max" };
+            reduction.reduce(buffer, count, Reduction::UINT, op);
+            ok &= report(std::string("reduce uint") + names[op] + suffix,
+                reduction.read_result<unsigned int>() == Reduction::reference(values, op));
+        }
+        glDeleteBuffers(1, &buffer);
+
+        buffer = upload(ints.data(), count * sizeof(GLint));
+        reduction.reduce(buffer, count, Reduction::INT, Reduction::MIN);
+        ok &= report("reduce int min" + suffix,
+            reduction.read_result<int>() == Reduction::reference(ints, Reduction::MIN));
+        glDeleteBuffers(1, &buffer);
+
+        // summed in a different order, within the rounding of the sequential sum
+        buffer = upload(floats.data(), count * sizeof(GLfloat));
+        reduction.reduce(buffer, count, Reduction::FLOAT, Reduction::SUM);
+        float sum = reduction.read_result<float>();
+        float expected = Reduction::reference(floats, Reduction::SUM);
+        ok &= report("reduce float sum" + suffix, std::abs(sum - expected) <= 1e-6f * count + 1e-5f);
+        glDeleteBuffers(1, &buffer);
+
+        buffer = upload(values.data(), count * sizeof(GLuint));
+        unsigned int flagBuffer = upload(flags.data(), count * sizeof(GLuint));
+        unsigned int output = upload(NULL, count * sizeof(GLuint));
+        compaction.compact(buffer, flagBuffer, output, count);
+        std::vector<unsigned int> kept = StreamCompaction::reference(values, flags);
+        unsigned int keptCount = compaction.read_count();
+        ok &= report("compact" + suffix, keptCount == kept.size() && download(output, keptCount) == kept);
+        glDeleteBuffers(1, &buffer);
+        glDeleteBuffers(1, &flagBuffer);
+        glDeleteBuffers(1, &output);
+    }
+    return ok;
+}
+
+
+/**
+ * @brief Runs steps steps of the integer diffusion of shaders/diffusion.comp
+ * on a PingPongBuffer and compares the result with the same steps on the CPU.
+ * An odd step count leaves the result in the copy the data did not start in.
+ *
+ * @return true if they matched
+ */
+bool check_ping_pong(std::mt19937& random)
+{
+    const int count = 1000003;
+    const int steps = 9;
+    std::vector<unsigned int> values(count);
+    for (unsigned int& value : values)
+        value = random() % 1000000;
+
+    PingPongBuffer state(count * sizeof(GLuint), values.data());
+    ComputeShader stepShader("shaders/diffusion.comp", "#define DIFFUSION_BUFFER\n");
+    stepShader.use();
+    stepShader.set_int("count", count);
+    state.iterate(steps, [&](int) { glDispatchCompute((count + 255) / 256, 1, 1); });
+
+    std::vector<unsigned int> next(count);
+    for (int step = 0; step < steps; step++)
+    {
+        for (int i = 0; i < count; i++)
+            next[i] = (values[std::max(i - 1, 0)] + 2 * values[i] + values[std::min(i + 1, count - 1)]) / 4;
+        values.swap(next);
+    }
+    bool ok = report("ping-pong buffer " + std::to_string(steps) + " steps " + std::to_string(count),
+        download(state.read(), count) == values);
+    glDeleteProgram(stepShader.ID);
+    return ok;
+}
+
+
+/**
+ * @brief Times every primitive on count values and reports its throughput
+ * counting each value read and written once by the whole primitive, the least
+ * traffic it could get away with; the extra passes lower the figure.
+ *
+ * @param count values per run
+ * @param runs runs timed per primitive
+ */
+void benchmark_primitives(unsigned int count, int runs, std::mt19937& random)
+{
+    std::vector<unsigned int> values(count), flags(count);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        values[i] = random() % 1000;
+        flags[i] = random() % 2;
+    }
+    PrefixScan scan(count);
+    Reduction reduction(count);
+    StreamCompaction compaction(count);
+    unsigned int buffer = upload(values.data(), count * sizeof(GLuint));
+    unsigned int flagBuffer = upload(flags.data(), count * sizeof(GLuint));
+    unsigned int output = upload(NULL, count * sizeof(GLuint));
+    GpuTimer timer;
+
+    auto time = [&](const std::string& name, double bytes, const std::function<void()>& run) {
+        // warm up
+        run();
+        timer.begin();
+        for (int i = 0; i < runs; i++)
+            run();
+        timer.end();
+        double ms = timer.elapsed_ms() / runs;
+        std::cout << "  " << name << ": " << ms << " ms, " << bytes / (ms * 1e6) << " GB/s, "
+            << count / (ms * 1e6) << " Gvalues/s" << std::endl;
+    };
+
+    const double bytes = (double)count * sizeof(GLuint);
+    std::cout << count << " values, " << runs << " runs:" << std::endl;
+    // scanning the same buffer again only changes the values, not the work
+    time("exclusive scan", 2.0 * bytes, [&] { scan.exclusive_scan(buffer, count); });
+    time("reduce uint sum", bytes, [&] { reduction.reduce(buffer, count, Reduction::UINT, Reduction::SUM); });
+    time("reduce uint max", bytes, [&] { reduction.reduce(buffer, count, Reduction::UINT, Reduction::MAX); });
+    // values and flags read, about half the values written
+    time("compact", 2.5 * bytes, [&] { compaction.compact(buffer, flagBuffer, output, count); });
+
+    glDeleteBuffers(1, &buffer);
+    glDeleteBuffers(1, &flagBuffer);
+    glDeleteBuffers(1, &output);
+}
+
+
+int main(int argc, char* argv[])
+{
+    unsigned int count = 1 << 24;
+    int runs = 20;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--count" && i + 1 < argc)
+            count = std::stoul(argv[++i]);
+        else if (arg == "--runs" && i + 1 < argc)
+            runs = std::stoi(argv[++i]);
+    }
+
+    // glfw: initialize and configure
+    // ------------------------------
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    // only the context is needed
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+    GLFWwindow* window = glfwCreateWindow(64, 64, "LearnOpenGL", NULL, NULL);
+    if (window == NULL)
+    {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+
+    // glad: load all OpenGL function pointers
+    // ---------------------------------------
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return -1;
+    }
+
+    std::mt19937 random(1234);
+    bool ok = check_primitives(random);
+    ok &= check_ping_pong(random);
+    benchmark_primitives(count, runs, random);
+
+    glfwTerminate();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,10 @@
+#version 430 core
+
+in vec4 color;
+
+out vec4 FragColor;
+
+void main()
+{
+    FragColor = color;
+}
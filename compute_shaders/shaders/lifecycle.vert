@@ -0,0 +1,27 @@
+#version 430 core
+
+// One point per alive particle, fetched through the alive list written by the
+// update pass of lifecycle.comp. The particle buffers and their accessors are
+// inserted by particles::ParticleStorage.
+
+layout(std430, binding = 4) readonly buffer aliveBuffer
+{
+    uint alive[];
+};
+
+uniform mat4 viewProjection;
+
+out vec4 color;
+
+void main()
+{
+    uint index = alive[gl_VertexID];
+    vec4 position_age = load_position(index);
+    float life = load_velocity(index).w;
+    vec4 particleColor = load_color(index);
+
+    // fade out over the lifetime
+    float age = position_age.w / life;
+    color = vec4(particleColor.rgb, particleColor.a * (1.0 - age));
+    gl_Position = viewProjection * vec4(position_age.xyz, 1.0);
+}
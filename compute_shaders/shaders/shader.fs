@@ -4,9 +4,28 @@ out vec4 FragColor;
 in vec2 TexCoords;
 	
 uniform sampler2D tex;
+
+#if defined(TONE_MAP)
+// written by the GPU every frame, see include/auto_exposure.hpp
+layout(std430, binding = 1) readonly buffer exposureBuffer
+{
+    float adaptedLuminance;
+    float exposure;
+};
+
+// filmic curve fitted to ACES, Narkowicz 2015
+vec3 aces(vec3 x)
+{
+    return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
+#endif
 	
 void main()
 {             
     vec3 texCol = texture(tex, TexCoords).rgb;      
+#if defined(TONE_MAP)
+    // exposed linear colour, tone mapped and gamma encoded
+    texCol = pow(aces(texCol * exposure), vec3(1.0 / 2.2));
+#endif
     FragColor = vec4(texCol, 1.0);
 }
\ No newline at end of file
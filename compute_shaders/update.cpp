@@ -2,8 +2,19 @@
 #include <cmath>
 
 #include "../include/glad/glad.h" 
+#include "../include/async_readback.hpp"
 #include "../include/shader.hpp"
 #include "../include/compute_shader.hpp"
+#include "../include/curl_noise.hpp"
+#include "../include/frame_capture.hpp"
+#include "../include/gpu_timer.hpp"
+#include "../include/particle_snapshot.hpp"
+#include "../include/pass_graph.hpp"
+#include "../include/radix_sort.hpp"
+#include "../include/simulation_clock.hpp"
+#include "../include/spatial_grid.hpp"
+#include "../include/thread_pool.hpp"
+#include "../include/workgroup_tuner.hpp"
 
 #include <GLFW/glfw3.h>
 
@@ -11,8 +22,14 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
 #include <random>
 #include <iostream>
+#include <string>
+#include <vector>
 
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -22,6 +39,19 @@ void processInput(GLFWwindow *window);
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 800;
 
+// box covered by the curl volume: the screen with some margin, and the range of noise_time()
+const float VOLUME_MIN[3] = { -1.5f, -1.5f, -0.005f };
+const float VOLUME_MAX[3] = { 1.5f, 1.5f, 0.005f };
+// bits per axis of the Morton codes of --sort-every, 1024 cells across the volume box
+const int MORTON_BITS = 10;
+
+// where the particle kernel runs
+enum Backend
+{
+    GPU,
+    CPU
+};
+
 
 struct randomf
 {
@@ -34,8 +64,507 @@ struct randomf
 } randf;
 
 
-int main()
+// time coordinate of the noise at a given simulation time, as uploaded to particle.comp
+float noise_time(float simulationTime)
+{
+    return 0.005 * glm::sin(0.005f * simulationTime);
+}
+
+
+/**
+ * @brief Compares the GPU positions with the CPU ones and prints the largest
+ * difference and the number of coordinates further apart than tolerance.
+ *
+ * @param gpu
+ * @param cpu
+ * @param tolerance
+ * @return true when every coordinate is within tolerance
+ */
+bool compare_positions(const std::vector<float>& gpu, const std::vector<float>& cpu, float tolerance)
+{
+    float maxError = 0.0f;
+    size_t mismatches = 0;
+    for (size_t i = 0; i < gpu.size(); i++)
+    {
+        float error = std::fabs(gpu[i] - cpu[i]);
+        maxError = std::max(maxError, error);
+        if (!(error <= tolerance))
+            mismatches++;
+    }
+    std::cout << "validate: max error " << maxError << ", " << mismatches << "/" << gpu.size()
+        << " coordinates above " << tolerance << std::endl;
+    return mismatches == 0;
+}
+
+
+/**
+ * @brief Bakes the curl volume into a new GL_RGBA16F 3D texture, on the GPU
+ * with the BAKE_CURL_VOLUME variant of particle.comp or on the CPU. The
+ * texture keeps the filter of the volume and clamps to its edges.
+ *
+ * @param volume size and box of the volume, its data is filled when baking on the CPU
+ * @param onCpu
+ * @param defines extra defines of the bake shader, e.g. the curl method
+ * @param pool
+ * @param method
+ * @return unsigned int the texture
+ */
+unsigned int bake_curl_volume(curl_noise::CurlVolume& volume, bool onCpu, const std::string& defines,
+    ThreadPool& pool, curl_noise::CurlMethod method)
+{
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_3D, texture);
+    glTexStorage3D(GL_TEXTURE_3D, 1, GL_RGBA16F, volume.size[0], volume.size[1], volume.size[2]);
+    GLint filter = volume.linear ? GL_LINEAR : GL_NEAREST;
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    double ms;
+    if (onCpu)
+    {
+        auto start = std::chrono::steady_clock::now();
+        curl_noise::bake_volume(volume, &pool, method);
+        ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, volume.size[0], volume.size[1], volume.size[2],
+            GL_RGBA, GL_FLOAT, volume.data.data());
+    }
+    else
+    {
+        ComputeShader bakeShader("shaders/particle.comp", defines + "\n#define BAKE_CURL_VOLUME");
+        bakeShader.use();
+        bakeShader.set_vec3("volumeMin", volume.min[0], volume.min[1], volume.min[2]);
+        bakeShader.set_vec3("volumeMax", volume.max[0], volume.max[1], volume.max[2]);
+        glBindImageTexture(0, texture, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+        GpuTimer timer;
+        timer.begin();
+        glDispatchCompute((volume.size[0] + 7) / 8, (volume.size[1] + 7) / 8, (volume.size[2] + 3) / 4);
+        timer.end();
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+        ms = timer.elapsed_ms();
+        glDeleteProgram(bakeShader.ID);
+    }
+
+    std::cout << "baked a " << volume.size[0] << "x" << volume.size[1] << "x" << volume.size[2]
+        << " curl volume on the " << (onCpu ? "CPU" : "GPU") << " in " << ms << " ms" << std::endl;
+    return texture;
+}
+
+
+// Reorders the particle and spawn buffers along a Morton curve of the positions,
+// so particles close on screen are close in memory and the noise and curl
+// volume fetches of a work group stay coherent.
+struct ParticleSorter
+{
+    // defines and local_size: variant and work group size of the particle kernels
+    ParticleSorter(unsigned int count, const std::string& defines, int local_size);
+    ~ParticleSorter();
+
+    // sorts the particles in place; uses SSBO binding points 0 to 6
+    void sort(unsigned int positions, unsigned int spawn);
+    // checks the keys of the last sort are ordered and its values a permutation
+    bool validate();
+
+    unsigned int count;
+    int local_size;
+    RadixSort radix_sort;
+    ComputeShader key_shader;
+    ComputeShader reorder_shader;
+    unsigned int keys, values, sorted_positions, sorted_spawn;
+};
+
+
+ParticleSorter::ParticleSorter(unsigned int count, const std::string& defines, int local_size) :
+    count(count), local_size(local_size), radix_sort(count),
+    key_shader("shaders/particle.comp", defines + "#define MORTON_KEYS"),
+    reorder_shader("shaders/particle.comp", defines + "#define REORDER_PARTICLES")
+{
+    unsigned int* buffers[4] = { &this->keys, &this->values, &this->sorted_positions, &this->sorted_spawn };
+    size_t sizes[4] = { sizeof(GLuint), sizeof(GLuint), 2 * sizeof(float), 2 * sizeof(float) };
+    for (int i = 0; i < 4; i++)
+    {
+        glGenBuffers(1, buffers[i]);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t)count * sizes[i], NULL, GL_DYNAMIC_COPY);
+    }
+}
+
+
+ParticleSorter::~ParticleSorter()
+{
+    glDeleteBuffers(1, &this->keys);
+    glDeleteBuffers(1, &this->values);
+    glDeleteBuffers(1, &this->sorted_positions);
+    glDeleteBuffers(1, &this->sorted_spawn);
+    glDeleteProgram(this->key_shader.ID);
+    glDeleteProgram(this->reorder_shader.ID);
+}
+
+
+void ParticleSorter::sort(unsigned int positions, unsigned int spawn)
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, positions);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, this->keys);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, this->values);
+    this->key_shader.use();
+    this->key_shader.set_int("mortonBits", MORTON_BITS);
+    this->key_shader.set_vec3("volumeMin", VOLUME_MIN[0], VOLUME_MIN[1], VOLUME_MIN[2]);
+    this->key_shader.set_vec3("volumeMax", VOLUME_MAX[0], VOLUME_MAX[1], VOLUME_MAX[2]);
+    glDispatchCompute(WorkgroupTuner::groups(this->count, this->local_size), 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    this->radix_sort.sort(this->keys, this->values, this->count, 2 * MORTON_BITS);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, positions);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, spawn);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, this->values);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, this->sorted_positions);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, this->sorted_spawn);
+    this->reorder_shader.use();
+    glDispatchCompute(WorkgroupTuner::groups(this->count, this->local_size), 1, 1);
+
+    // a gather cannot run in place, copy the sorted particles back
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    size_t bytes = (size_t)this->count * 2 * sizeof(float);
+    glBindBuffer(GL_COPY_READ_BUFFER, this->sorted_positions);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, positions);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, bytes);
+    glBindBuffer(GL_COPY_READ_BUFFER, this->sorted_spawn);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, spawn);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, bytes);
+}
+
+
+bool ParticleSorter::validate()
 {
+    std::vector<GLuint> sortedKeys(this->count), sortedValues(this->count);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, this->keys);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, this->count * sizeof(GLuint), sortedKeys.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, this->values);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, this->count * sizeof(GLuint), sortedValues.data());
+
+    size_t unordered = 0;
+    std::vector<bool> seen(this->count, false);
+    size_t duplicates = 0;
+    for (size_t i = 0; i < this->count; i++)
+    {
+        if (i > 0 && sortedKeys[i] < sortedKeys[i - 1])
+            unordered++;
+        if (sortedValues[i] >= this->count || seen[sortedValues[i]])
+            duplicates++;
+        else
+            seen[sortedValues[i]] = true;
+    }
+    std::cout << "validate sort: " << unordered << " keys out of order, "
+        << duplicates << " values missing or repeated" << std::endl;
+    return unordered == 0 && duplicates == 0;
+}
+
+
+/**
+ * @brief CPU reference of the NEIGHBOUR_FORCES pass of particle.comp: builds
+ * the grid of the positions, then pushes apart the particles closer than radius.
+ *
+ * @param positions interleaved xy positions, moved in place
+ * @param desc
+ * @param grid receives the grid of the starting positions
+ * @param radius
+ * @param strength
+ * @param pool
+ */
+void separate_particles(std::vector<float>& positions, const spatial_grid::GridDesc& desc,
+    spatial_grid::CpuGrid& grid, float radius, float strength, ThreadPool& pool)
+{
+    const std::vector<float> start = positions;
+    size_t count = positions.size() / 2;
+    spatial_grid::build_cpu(desc, start.data(), 2, count, grid);
+
+    pool.parallel_for(0, count, 4096, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+        {
+            float p[3] = { start[2 * i], start[2 * i + 1], 0.0f };
+            float push[2] = { 0.0f, 0.0f };
+            spatial_grid::for_each_neighbour(desc, grid, p, [&](unsigned int j) {
+                float d[2] = { p[0] - start[2 * j], p[1] - start[2 * j + 1] };
+                float distance2 = d[0] * d[0] + d[1] * d[1];
+                if (j == i || distance2 >= radius * radius || distance2 == 0.0f)
+                    return;
+                float distance = std::sqrt(distance2);
+                float weight = 1.0f - distance / radius;
+                push[0] += d[0] / distance * weight;
+                push[1] += d[1] / distance * weight;
+            });
+            positions[2 * i] += strength * radius * push[0];
+            positions[2 * i + 1] += strength * radius * push[1];
+        }
+    });
+}
+
+
+/**
+ * @brief Runs the CPU kernel without a window, for machines without an
+ * OpenGL 4.3 GPU, and reports its cost with and without SIMD and threads
+ * for both curl methods and the baked volume, then how far apart the two
+ * methods are.
+ *
+ * @param frames
+ * @param pool
+ * @param particles interleaved xy positions
+ * @param spawn interleaved xy spawn points
+ * @param clock step and step length of the first frame
+ * @param volume baked volume to time as well, skipped if null
+ */
+void run_headless(int frames, ThreadPool& pool, const std::vector<float>& particles,
+    const std::vector<float>& spawn, const SimulationClock& clock, const curl_noise::CurlVolume* volume)
+{
+    using curl_noise::CurlMethod;
+    int count = particles.size() / 2;
+
+    struct Variant
+    {
+        const char* name;
+        ThreadPool* pool;
+        bool simd;
+    };
+    const Variant variants[] = {
+        { "scalar", nullptr, false },
+        { "simd", nullptr, true },
+        { "simd + threads", &pool, true },
+    };
+
+    std::cout << count << " particles, " << frames << " frames, "
+        << pool.size() << " threads" << std::endl;
+
+    auto run = [&](const Variant& variant, const curl_noise::KernelOptions& options, std::vector<float>& positions) {
+        positions = particles;
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < frames; frame++)
+            curl_noise::update_particles(positions.data(), spawn.data(), count,
+                noise_time((clock.step + frame) * clock.step_seconds), variant.pool, options);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        double checksum = 0.0;
+        for (float p : positions)
+            checksum += p;
+        std::cout << "  " << variant.name << ": " << ms / frames << " ms/frame, checksum " << checksum << std::endl;
+    };
+
+    std::vector<float> positions;
+    std::vector<float> analyticPositions;
+    for (CurlMethod method : { curl_noise::ANALYTIC, curl_noise::FINITE_DIFFERENCE })
+    {
+        std::cout << (method == curl_noise::ANALYTIC ? "analytic curl" : "finite difference curl") << std::endl;
+        for (const Variant& variant : variants)
+        {
+            curl_noise::KernelOptions options;
+            options.simd = variant.simd;
+            options.method = method;
+            run(variant, options, positions);
+        }
+        if (method == curl_noise::ANALYTIC)
+            analyticPositions = positions;
+    }
+
+    if (volume != nullptr)
+    {
+        std::cout << "curl volume" << std::endl;
+        curl_noise::KernelOptions options;
+        options.volume = volume;
+        run(variants[1], options, positions);
+        run(variants[2], options, positions);
+
+        // how far the particles drifted from the noise driven ones
+        double sumDistance = 0.0;
+        for (int i = 0; i < count; i++)
+            sumDistance += glm::length(glm::vec2(positions[2 * i] - analyticPositions[2 * i],
+                positions[2 * i + 1] - analyticPositions[2 * i + 1]));
+        std::cout << "  mean distance to the analytic positions: " << sumDistance / count << std::endl;
+    }
+
+    // angle between the two velocity fields, both sampled where the analytic run
+    // left the particles; positions holds the last run, which depends on --volume
+    double sumAngle = 0.0, maxAngle = 0.0;
+    for (int i = 0; i < count; i++)
+    {
+        curl_noise::Vec3<float> p = { analyticPositions[2 * i], analyticPositions[2 * i + 1],
+            noise_time((clock.step + frames) * clock.step_seconds) };
+        float cosAngle = curl_noise::dot(curl_noise::curl(p, curl_noise::ANALYTIC),
+            curl_noise::curl(p, curl_noise::FINITE_DIFFERENCE));
+        double angle = glm::degrees(std::acos(glm::clamp((double)cosAngle, -1.0, 1.0)));
+        sumAngle += angle;
+        maxAngle = std::max(maxAngle, angle);
+    }
+    std::cout << "analytic vs finite difference: mean " << sumAngle / count
+        << " deg, max " << maxAngle << " deg" << std::endl;
+}
+
+
+int main(int argc, char* argv[])
+{
+    Backend backend = GPU;
+    curl_noise::CurlMethod method = curl_noise::ANALYTIC;
+    int validateEvery = 0;
+    float tolerance = 1e-3f;
+    int headlessFrames = 0;
+    unsigned int threadCount = 0;
+    int numberOfParticles = 2048;
+    // curl volume: 0 evaluates the noise per particle
+    int volumeSize = 0;
+    int volumeDepth = 4;
+    bool volumeLinear = true;
+    bool bakeOnCpu = false;
+    // Morton sort of the particles every N frames, 0 never
+    int sortEvery = 0;
+    // particles closer than this push each other apart, 0 disables the interaction
+    float interactionRadius = 0.0f;
+    float interactionStrength = 0.5f;
+    // fixed timestep clock and snapshots: the particles only depend on the step
+    // count (the order of the --interact sums aside, which follows GPU atomics)
+    double stepHz = 60.0;
+    // one step per rendered frame whatever the frame time, for benchmarks
+    bool lockstep = false;
+    // exits after this many steps and prints the time and a checksum of the positions
+    uint64_t runSteps = 0;
+    // snapshot written at step saveAt, or on exit
+    std::string savePath;
+    uint64_t saveAt = std::numeric_limits<uint64_t>::max();
+    // snapshot to start from
+    std::string replayPath;
+    // copies the positions back every frame without waiting on the GPU and
+    // prints their centroid with the FPS
+    bool readback = false;
+    // picks the work group size of the particle kernels, cached in workgroup_sizes.txt
+    bool tune = false;
+    // prints the barriers the pass graph placed on exit
+    bool barrierReport = false;
+    // records the window to a .y4m or raw RGBA file, "-" for stdout; every
+    // frame then advances the clock by 1 / captureFps so the video keeps the
+    // simulation speed whatever the frame rate
+    std::string capturePath;
+    int captureFps = 60;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--cpu")
+            backend = CPU;
+        else if (arg == "--validate")
+            validateEvery = 60;
+        else if (arg == "--validate-every" && i + 1 < argc)
+            validateEvery = std::stoi(argv[++i]);
+        else if (arg == "--tolerance" && i + 1 < argc)
+            tolerance = std::stof(argv[++i]);
+        else if (arg == "--headless" && i + 1 < argc)
+            headlessFrames = std::stoi(argv[++i]);
+        else if (arg == "--threads" && i + 1 < argc)
+            threadCount = std::stoul(argv[++i]);
+        else if (arg == "--finite-difference")
+            method = curl_noise::FINITE_DIFFERENCE;
+        else if (arg == "--count" && i + 1 < argc)
+            numberOfParticles = std::stoi(argv[++i]);
+        else if (arg == "--volume" && i + 1 < argc)
+            volumeSize = std::stoi(argv[++i]);
+        else if (arg == "--volume-depth" && i + 1 < argc)
+            volumeDepth = std::stoi(argv[++i]);
+        else if (arg == "--volume-nearest")
+            volumeLinear = false;
+        else if (arg == "--bake-cpu")
+            bakeOnCpu = true;
+        else if (arg == "--sort-every" && i + 1 < argc)
+            sortEvery = std::stoi(argv[++i]);
+        else if (arg == "--interact" && i + 1 < argc)
+            interactionRadius = std::stof(argv[++i]);
+        else if (arg == "--interact-strength" && i + 1 < argc)
+            interactionStrength = std::stof(argv[++i]);
+        else if (arg == "--step-hz" && i + 1 < argc)
+            stepHz = std::stod(argv[++i]);
+        else if (arg == "--lockstep")
+            lockstep = true;
+        else if (arg == "--run-steps" && i + 1 < argc)
+            runSteps = std::stoull(argv[++i]);
+        else if (arg == "--save" && i + 1 < argc)
+            savePath = argv[++i];
+        else if (arg == "--save-at" && i + 1 < argc)
+            saveAt = std::stoull(argv[++i]);
+        else if (arg == "--replay" && i + 1 < argc)
+            replayPath = argv[++i];
+        else if (arg == "--seed" && i + 1 < argc)
+            randf.rng.seed(std::stoul(argv[++i]));
+        else if (arg == "--readback")
+            readback = true;
+        else if (arg == "--tune")
+            tune = true;
+        else if (arg == "--barrier-report")
+            barrierReport = true;
+        else if (arg == "--capture" && i + 1 < argc)
+            capturePath = argv[++i];
+        else if (arg == "--capture-fps" && i + 1 < argc)
+            captureFps = std::stoi(argv[++i]);
+    }
+    // the video owns stdout, the console output goes to stderr
+    std::streambuf* coutBuffer = std::cout.rdbuf();
+    if (capturePath == "-")
+        std::cout.rdbuf(std::cerr.rdbuf());
+
+    ThreadPool pool(threadCount);
+
+    std::vector<float> particles(numberOfParticles * 2);
+    for (int i = 0; i < numberOfParticles; i++) {
+        particles[i * 2] = (randf.gen() - 0.5f) * 1.0f;
+        particles[i * 2 + 1] = -1.0f;
+    }
+    // the kernel respawns particles at their initial x
+    std::vector<float> initialPositions = particles;
+
+    SimulationClock clock(1.0 / stepHz);
+    clock.lockstep = lockstep;
+    if (!replayPath.empty())
+    {
+        snapshot::Header header;
+        std::vector<std::vector<float>> arrays;
+        if (!snapshot::load(replayPath, header, arrays))
+            return -1;
+        if (header.components != 2 || header.array_count != 2)
+        {
+            std::cout << "ERROR::SNAPSHOT::NOT_A_PARTICLE_SNAPSHOT: " << replayPath << std::endl;
+            return -1;
+        }
+        numberOfParticles = header.count;
+        particles = arrays[0];
+        initialPositions = arrays[1];
+        // the snapshot step length wins, the noise time of every step depends on it
+        clock.step = header.step;
+        clock.step_seconds = header.step_seconds;
+        std::cout << "replaying " << replayPath << ": " << header.count << " particles from step "
+            << header.step << " at " << 1.0 / header.step_seconds << " Hz" << std::endl;
+    }
+
+    curl_noise::CurlVolume volume = curl_noise::make_volume(volumeSize, volumeSize, volumeDepth,
+        VOLUME_MIN, VOLUME_MAX, volumeLinear);
+    // one layer of cells over the box of the volume, the particles are flat
+    const float gridMin[3] = { VOLUME_MIN[0], VOLUME_MIN[1], 0.0f };
+    const float gridMax[3] = { VOLUME_MAX[0], VOLUME_MAX[1], 0.0f };
+    spatial_grid::GridDesc gridDesc = spatial_grid::make_grid(gridMin, gridMax,
+        interactionRadius > 0.0f ? interactionRadius : 1.0f);
+    spatial_grid::CpuGrid cpuGrid;
+
+    curl_noise::KernelOptions kernelOptions;
+    kernelOptions.method = method;
+    if (volumeSize > 0)
+        kernelOptions.volume = &volume;
+
+    if (headlessFrames > 0)
+    {
+        if (volumeSize > 0)
+            curl_noise::bake_volume(volume, &pool, method);
+        run_headless(headlessFrames, pool, particles, initialPositions, clock, kernelOptions.volume);
+        return 0;
+    }
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -43,6 +572,9 @@ int main()
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_SAMPLES, 4);
+    // the capture size is fixed when the capture starts
+    if (!capturePath.empty())
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
     // glEnable(GL_MULTISAMPLE);  
 
 #ifdef __APPLE__
@@ -77,21 +609,24 @@ int main()
 
     // build and compile our shader zprogram
     // ------------------------------------
-    ComputeShader particleComputeShader("shaders/particle.comp");
+    std::string defines = method == curl_noise::FINITE_DIFFERENCE ? "#define CURL_FINITE_DIFFERENCE\n" : "";
     Shader particleShader("shaders/particle.vert", "shaders/particle.frag");
 
     particleShader.use();
     glm::mat4 model = glm::mat4(1.0f);
     particleShader.set_mat4("model", model);
 
-    int numberOfParticles = 2048;
-    float particles[numberOfParticles* 2];
     glPointSize(4.0f);
 
-    for(int i = 0; i < numberOfParticles; i++) {
-        particles[i * 2] = (randf.gen() - 0.5f) * 1.0f;
-        particles[i * 2 + 1] = -1.0f;
+    unsigned int CURL_VOLUME = 0;
+    if (volumeSize > 0)
+    {
+        CURL_VOLUME = bake_curl_volume(volume, bakeOnCpu, defines, pool, method);
+        // the CPU kernel samples the same half precision texels as the GPU
+        if (backend == CPU || validateEvery > 0)
+            glGetTexImage(GL_TEXTURE_3D, 0, GL_RGBA, GL_FLOAT, volume.data.data());
     }
+
     unsigned int PARTICLE_VAO, PARTICLE_VBO;
     glGenVertexArrays(1, &PARTICLE_VAO);
     glGenBuffers(1, &PARTICLE_VBO);
@@ -99,7 +634,7 @@ int main()
     glBindVertexArray(PARTICLE_VAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, PARTICLE_VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(particles), particles, GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, particles.size() * sizeof(float), particles.data(), GL_DYNAMIC_DRAW);
 
     // position attribute
     glEnableVertexAttribArray(0);
@@ -107,16 +642,167 @@ int main()
 
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, PARTICLE_VBO);
 
+    unsigned int SPAWN_SSBO;
+    glGenBuffers(1, &SPAWN_SSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, SPAWN_SSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, initialPositions.size() * sizeof(float), initialPositions.data(), GL_STATIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, SPAWN_SSBO);
+
+    if (volumeSize > 0)
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_3D, CURL_VOLUME);
+    }
+    std::string kernelDefines = volumeSize > 0 ? defines + "#define CURL_VOLUME\n" : defines;
+    auto setKernelUniforms = [&](ComputeShader& shader) {
+        if (volumeSize > 0)
+        {
+            shader.set_int("curlVolume", 0);
+            shader.set_vec3("volumeMin", volume.min[0], volume.min[1], volume.min[2]);
+            shader.set_vec3("volumeMax", volume.max[0], volume.max[1], volume.max[2]);
+        }
+    };
+
+    // every particle.comp kernel below shares the work group size of the update kernel
+    LocalSize localSize = { 1024, 1, 1 };
+    if (tune && backend == GPU)
+    {
+        // tuned on copies, the run itself must not move
+        unsigned int scratch[2];
+        glGenBuffers(2, scratch);
+        unsigned int sources[2] = { PARTICLE_VBO, SPAWN_SSBO };
+        for (int i = 0; i < 2; i++)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, scratch[i]);
+            glBufferData(GL_COPY_WRITE_BUFFER, particles.size() * sizeof(float), NULL, GL_DYNAMIC_COPY);
+            glBindBuffer(GL_COPY_READ_BUFFER, sources[i]);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, particles.size() * sizeof(float));
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i + 1, scratch[i]);
+        }
+
+        WorkgroupTuner tuner;
+        std::string key = "particle.comp" + std::string(volumeSize > 0 ? " CURL_VOLUME" : "")
+            + (method == curl_noise::FINITE_DIFFERENCE ? " CURL_FINITE_DIFFERENCE" : "")
+            + " " + std::to_string(numberOfParticles);
+        localSize = tuner.tune(key, "shaders/particle.comp", kernelDefines, WorkgroupTuner::candidates_1d(),
+            [&](ComputeShader& shader, const LocalSize& size) {
+                shader.use();
+                setKernelUniforms(shader);
+                shader.set_float("t", 0.0f);
+                glDispatchCompute(WorkgroupTuner::groups(numberOfParticles, size.x), 1, 1);
+                glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            });
+        std::cout << "work group " << localSize.x << std::endl;
+
+        glDeleteBuffers(2, scratch);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, PARTICLE_VBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, SPAWN_SSBO);
+    }
+    defines += WorkgroupTuner::glsl(localSize);
+    ComputeShader particleComputeShader("shaders/particle.comp", kernelDefines + WorkgroupTuner::glsl(localSize));
     particleComputeShader.use();
-    for (size_t i = 0; i < numberOfParticles; i++)
+    setKernelUniforms(particleComputeShader);
+
+    // sorting reorders the GPU buffers, the CPU kernel keeps its own order
+    ParticleSorter* sorter = nullptr;
+    if (sortEvery > 0 && backend == GPU)
+        sorter = new ParticleSorter(numberOfParticles, defines, localSize.x);
+    GpuTimer sortTimer;
+
+    spatial_grid::SpatialGrid* grid = nullptr;
+    ComputeShader* forceShader = nullptr;
+    if (interactionRadius > 0.0f && backend == GPU)
+    {
+        grid = new spatial_grid::SpatialGrid(gridDesc, numberOfParticles, 2);
+        forceShader = new ComputeShader("shaders/particle.comp", defines + grid->glsl() + "#define NEIGHBOUR_FORCES");
+        std::cout << gridDesc.size[0] << "x" << gridDesc.size[1] << " grid cells" << std::endl;
+    }
+    spatial_grid::CpuGrid gpuGrid;
+    GpuTimer gridTimer;
+
+    AsyncReadback* positionReadback = nullptr;
+    if (readback)
+        positionReadback = new AsyncReadback(particles.size() * sizeof(float));
+    // frames rendered, tags the readbacks to measure their latency
+    uint64_t frameIndex = 0;
+    float centroid[2] = { 0.0f, 0.0f };
+    uint64_t readbackLatency = 0;
+
+    FrameCapture* capture = nullptr;
+    if (!capturePath.empty())
     {
-        particleComputeShader.set_vec2("initialPos["+ std::to_string(i) + "]", 
-            particles[2 * i], particles[2 * i + 1]);
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        capture = new FrameCapture(capturePath, width, height, captureFps);
     }
 
+    // scratch copies for --validate
+    std::vector<float> gpuPositions(particles.size());
+    std::vector<float> cpuPositions(particles.size());
+    std::vector<float> spawnPositions(initialPositions.size());
+    bool sorted = false;
+    bool kernelTimed = false;
+
+    // --run-steps stops here, --save-at saves here
+    uint64_t lastStep = runSteps > 0 ? clock.step + runSteps : std::numeric_limits<uint64_t>::max();
+    bool saved = false;
+    auto runStart = std::chrono::steady_clock::now();
+
+    // cost of the particle update, GPU dispatch or CPU kernel
+    GpuTimer kernelTimer;
+    double cpuKernelMs = 0.0;
+
+    // the GPU passes of a step and of a frame, with the barriers between them
+    // placed from what each one reads and writes
+    using pass_graph::read;
+    using pass_graph::write;
+    using pass_graph::read_write;
+    pass_graph::PassGraph graph;
+    int particleResource = graph.resource("particles");
+    int spawnResource = graph.resource("spawn");
+    float stepTime = 0.0f;
+    // the sort gathers into scratch buffers and copies the result back
+    int sortPass = graph.add_pass("sort", {
+        read(particleResource, pass_graph::SHADER_STORAGE), write(particleResource, pass_graph::BUFFER_UPDATE),
+        read(spawnResource, pass_graph::SHADER_STORAGE), write(spawnResource, pass_graph::BUFFER_UPDATE) }, [&] {
+            sortTimer.begin();
+            sorter->sort(PARTICLE_VBO, SPAWN_SSBO);
+            sortTimer.end();
+        });
+    int forcePass = graph.add_pass("grid + forces", { read_write(particleResource, pass_graph::SHADER_STORAGE) }, [&] {
+        gridTimer.begin();
+        grid->build(PARTICLE_VBO, numberOfParticles);
+        grid->bind();
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, PARTICLE_VBO);
+        forceShader->use();
+        forceShader->set_float("interactionRadius", interactionRadius);
+        forceShader->set_float("interactionStrength", interactionStrength);
+        glDispatchCompute(WorkgroupTuner::groups(numberOfParticles, localSize.x), 1, 1);
+        gridTimer.end();
+    });
+    int updatePass = graph.add_pass("update", {
+        read_write(particleResource, pass_graph::SHADER_STORAGE), read(spawnResource, pass_graph::SHADER_STORAGE) }, [&] {
+            particleComputeShader.use();
+            particleComputeShader.set_float("t", stepTime);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, PARTICLE_VBO);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, SPAWN_SSBO);
+            kernelTimer.begin();
+            glDispatchCompute(WorkgroupTuner::groups(numberOfParticles, localSize.x), 1, 1);
+            kernelTimer.end();
+        });
+    int readbackPass = graph.add_pass("readback", { read(particleResource, pass_graph::BUFFER_UPDATE) }, [&] {
+        // frames are skipped while the ring is full, never waited for
+        positionReadback->read_buffer(PARTICLE_VBO, 0, particles.size() * sizeof(float), frameIndex);
+    });
+    int drawPass = graph.add_pass("draw", { read(particleResource, pass_graph::VERTEX_ATTRIB) }, [&] {
+        particleShader.use();
+        particleShader.set_vec4("u_color", 0.0f, 0.5f, 1.0f, 1.0f);
+        glDrawArrays(GL_POINTS, 0, numberOfParticles);
+    });
+
     // timing 
     float deltaTime = 0.0f; // time between current frame and last frame
-    float lastFrame = 0.0f; // time of last frame
+    float lastFrame = glfwGetTime(); // time of last frame
     int fCounter = 0;
 
     // render loop
@@ -129,7 +815,16 @@ int main()
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
         if(fCounter > 500) {
-                std::cout << "FPS: " << 1 / deltaTime << std::endl;
+                double kernelMs = backend == CPU ? cpuKernelMs : kernelTimer.elapsed_ms();
+                std::cout << "FPS: " << 1 / deltaTime << ", kernel: " << kernelMs << " ms";
+                if (sorter != nullptr)
+                    std::cout << ", sort: " << sortTimer.elapsed_ms() << " ms";
+                if (grid != nullptr)
+                    std::cout << ", grid + forces: " << gridTimer.elapsed_ms() << " ms";
+                if (positionReadback != nullptr)
+                    std::cout << ", centroid: (" << centroid[0] << ", " << centroid[1] << ") "
+                        << readbackLatency << " frames late";
+                std::cout << std::endl;
                 fCounter = 0;
         } else {
             fCounter++;
@@ -143,18 +838,119 @@ int main()
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); 
 
-        // activate shader
-        particleComputeShader.use();
-        particleComputeShader.set_float("t", 0.005 * glm::sin(0.005f * currentFrame));
         glBindVertexArray(PARTICLE_VAO);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, PARTICLE_VBO);
-        glDispatchCompute(numberOfParticles / 1024, 1, 1);
-
-        glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
-
-        particleShader.use();
-        particleShader.set_vec4("u_color", 0.0f, 0.5f, 1.0f, 1.0f);
-        glDrawArrays(GL_POINTS, 0, numberOfParticles);
+        glBindBuffer(GL_ARRAY_BUFFER, PARTICLE_VBO);
+
+        // fixed steps, as many as the frame time calls for; a frame never runs
+        // past the snapshot step or the end of --run-steps
+        uint64_t steps = clock.advance(capture != nullptr ? 1.0 / captureFps : deltaTime);
+        if (!savePath.empty() && clock.step < saveAt)
+            steps = std::min(steps, saveAt - clock.step);
+        steps = std::min(steps, lastStep - clock.step);
+        for (uint64_t s = 0; s < steps; s++)
+        {
+            uint64_t step = clock.step;
+            float t = noise_time(clock.time());
+
+            if (backend == CPU)
+            {
+                auto start = std::chrono::steady_clock::now();
+                if (interactionRadius > 0.0f)
+                    separate_particles(particles, gridDesc, cpuGrid, interactionRadius, interactionStrength, pool);
+                curl_noise::update_particles(particles.data(), initialPositions.data(), numberOfParticles, t,
+                    &pool, kernelOptions);
+                cpuKernelMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+            else
+            {
+                bool validate = validateEvery > 0 && step % validateEvery == 0;
+
+                // sorts on fixed steps, so a replay sorts where the original run did
+                if (sorter != nullptr && step > 0 && step % sortEvery == 0)
+                {
+                    if (!sorted && kernelTimed)
+                        std::cout << "kernel before the first sort: " << kernelTimer.elapsed_ms() << " ms" << std::endl;
+                    graph.run(sortPass);
+                    sorted = true;
+                    if (validate)
+                        sorter->validate();
+                }
+
+                if (validate)
+                {
+                    // the previous dispatch must be visible to the readback
+                    graph.barrier("validate before", GL_BUFFER_UPDATE_BARRIER_BIT);
+                    glGetBufferSubData(GL_ARRAY_BUFFER, 0, cpuPositions.size() * sizeof(float), cpuPositions.data());
+                    // sorting moves the spawn points along with the particles
+                    glBindBuffer(GL_COPY_READ_BUFFER, SPAWN_SSBO);
+                    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, spawnPositions.size() * sizeof(float), spawnPositions.data());
+                }
+
+                if (grid != nullptr)
+                {
+                    graph.run(forcePass);
+                    if (validate)
+                        grid->read_back(gpuGrid, numberOfParticles);
+                }
+
+                stepTime = t;
+                graph.run(updatePass);
+                kernelTimed = true;
+
+                if (validate)
+                {
+                    // run the same step on the CPU from the same starting positions
+                    graph.barrier("validate after", GL_BUFFER_UPDATE_BARRIER_BIT);
+                    glGetBufferSubData(GL_ARRAY_BUFFER, 0, gpuPositions.size() * sizeof(float), gpuPositions.data());
+                    if (grid != nullptr)
+                    {
+                        separate_particles(cpuPositions, gridDesc, cpuGrid, interactionRadius, interactionStrength, pool);
+                        std::cout << "validate grid: " << spatial_grid::count_mismatches(gpuGrid, cpuGrid) << "/"
+                            << spatial_grid::cell_count(gridDesc) << " cells differ" << std::endl;
+                    }
+                    curl_noise::update_particles(cpuPositions.data(), spawnPositions.data(), numberOfParticles, t,
+                        &pool, kernelOptions);
+                    compare_positions(gpuPositions, cpuPositions, tolerance);
+                }
+            }
+            clock.tick();
+        }
+        if (backend == CPU && steps > 0)
+            glBufferSubData(GL_ARRAY_BUFFER, 0, particles.size() * sizeof(float), particles.data());
+
+        if (positionReadback != nullptr)
+        {
+            graph.run(readbackPass);
+            Span span;
+            if (positionReadback->poll(span))
+            {
+                const float* positions = span.as<float>();
+                double sum[2] = { 0.0, 0.0 };
+                for (size_t i = 0; i < span.count<float>(); i += 2)
+                {
+                    sum[0] += positions[i];
+                    sum[1] += positions[i + 1];
+                }
+                centroid[0] = (float)(sum[0] / numberOfParticles);
+                centroid[1] = (float)(sum[1] / numberOfParticles);
+                readbackLatency = frameIndex - span.tag;
+                positionReadback->release(span);
+            }
+        }
+        frameIndex++;
+
+        if (!savePath.empty() && !saved && clock.step == saveAt)
+        {
+            // save() issues its own buffer update barrier before mapping the buffers
+            saved = snapshot::save(savePath, snapshot::make_header(clock.step, clock.step_seconds,
+                numberOfParticles, 2, 2), { PARTICLE_VBO, SPAWN_SSBO });
+        }
+        if (clock.step >= lastStep)
+            glfwSetWindowShouldClose(window, true);
+
+        graph.run(drawPass);
+        if (capture != nullptr)
+            capture->capture();
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
@@ -162,10 +958,44 @@ int main()
         glfwPollEvents();
     }
 
+    if (runSteps > 0)
+    {
+        // the checksum matches between runs of the same workload
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+        // the draw barrier only covered vertex fetches, not buffer reads
+        graph.barrier("checksum", GL_BUFFER_UPDATE_BARRIER_BIT);
+        glBindBuffer(GL_ARRAY_BUFFER, PARTICLE_VBO);
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, gpuPositions.size() * sizeof(float), gpuPositions.data());
+        double checksum = 0.0;
+        for (float p : gpuPositions)
+            checksum += p;
+        std::cout << "ran " << runSteps << " steps to step " << clock.step << " in " << seconds << " s ("
+            << runSteps / seconds << " steps/s), checksum " << checksum << std::endl;
+    }
+    if (barrierReport)
+        graph.report();
+    // without --save-at the snapshot is taken on exit
+    if (!savePath.empty() && !saved)
+    {
+        snapshot::save(savePath, snapshot::make_header(clock.step, clock.step_seconds, numberOfParticles, 2, 2),
+            { PARTICLE_VBO, SPAWN_SSBO });
+    }
+
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
     glDeleteVertexArrays(1, &PARTICLE_VAO);
     glDeleteBuffers(1, &PARTICLE_VBO);
+    glDeleteBuffers(1, &SPAWN_SSBO);
+    delete sorter;
+    delete grid;
+    delete positionReadback;
+    delete capture;
+    std::cout.rdbuf(coutBuffer);
+    if (forceShader != nullptr)
+        glDeleteProgram(forceShader->ID);
+    delete forceShader;
+    if (CURL_VOLUME != 0)
+        glDeleteTextures(1, &CURL_VOLUME);
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -0,0 +1 @@
+g++ sphere_field.cpp src/glad.c -o sphere_field.out -lglfw -lGL -lX11 -lpthread -lXrandr -lXi -ldl
\ No newline at end of file
@@ -0,0 +1,278 @@
+#ifndef ASYNC_READBACK_H
+#define ASYNC_READBACK_H
+
+#include "glad/glad.h"
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+
+// Data of a finished readback, mapped straight from its pack buffer: no copy is
+// made, and the pointer stays valid until the span is released
+struct Span
+{
+    const void* data;
+    size_t size;
+    // tag given when the readback was queued, e.g. the frame number
+    uint64_t tag;
+    // ring slot the span belongs to
+    int slot;
+
+    template <typename T>
+    const T* as() const { return static_cast<const T*>(this->data); }
+    template <typename T>
+    size_t count() const { return this->size / sizeof(T); }
+};
+
+
+// GPU to CPU readback that never stalls the pipeline. Copies go into a ring of
+// pack buffers (glCopyBufferSubData for buffers, glGetTexImage and
+// glReadPixels into a GL_PIXEL_PACK_BUFFER for textures and framebuffers), each
+// followed by a fence; poll() hands out the oldest copy once its fence has
+// signalled, usually one or two frames later. A slot is busy from the queue
+// call until its span is released, so a consumer holding spans or a GPU running
+// behind makes read_*() return false instead of waiting. Shader writes to the
+// source must be made visible first, with GL_BUFFER_UPDATE_BARRIER_BIT for
+// buffers and GL_TEXTURE_UPDATE_BARRIER_BIT for textures, e.g. by reading it
+// with pass_graph::BUFFER_UPDATE or TEXTURE_UPDATE from a pass.
+class AsyncReadback
+{
+public:
+    // slot_bytes: largest single readback
+    AsyncReadback(size_t slot_bytes, int ring_size = 3);
+    ~AsyncReadback();
+
+    // queues a copy of size bytes of buffer from offset; false when no slot is free
+    bool read_buffer(unsigned int buffer, size_t offset, size_t size, uint64_t tag = 0);
+    // queues a copy of level 0 of a texture as format/type texels of size bytes in
+    // total; leaves the texture bound to target on the active unit
+    bool read_texture(unsigned int texture, GLenum target, GLenum format, GLenum type, size_t size, uint64_t tag = 0);
+    // queues a glReadPixels of a rectangle of the read buffer of framebuffer, 0
+    // being the window; leaves framebuffer bound to GL_READ_FRAMEBUFFER
+    bool read_framebuffer(unsigned int framebuffer, int x, int y, int width, int height, GLenum format, GLenum type,
+        size_t size, uint64_t tag = 0);
+    // maps the oldest queued readback if it is done, without waiting
+    bool poll(Span& span);
+    // same, but waits for the GPU when the oldest readback is not done yet
+    bool wait(Span& span);
+    // unmaps a span and gives its slot back to the ring
+    void release(const Span& span);
+    // readbacks queued but not handed out yet
+    int pending() const;
+
+private:
+    enum SlotState
+    {
+        FREE,
+        PENDING,
+        MAPPED
+    };
+
+    struct Slot
+    {
+        unsigned int buffer;
+        GLsync fence;
+        size_t size;
+        uint64_t tag;
+        SlotState state;
+    };
+
+    int acquire(size_t size);
+    void queued(int index, size_t size, uint64_t tag);
+    bool map_oldest(Span& span, GLuint64 timeout_ns);
+
+    size_t slot_bytes;
+    std::vector<Slot> slots;
+    // next slot to fill and oldest slot to hand out, the ring is used in order
+    int head;
+    int tail;
+};
+
+
+AsyncReadback::AsyncReadback(size_t slot_bytes, int ring_size) :
+    slot_bytes(slot_bytes), slots(ring_size), head(0), tail(0)
+{
+    for (Slot& slot : this->slots)
+    {
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, slot_bytes, NULL, GL_STREAM_READ);
+        slot.fence = 0;
+        slot.size = 0;
+        slot.tag = 0;
+        slot.state = FREE;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+
+AsyncReadback::~AsyncReadback()
+{
+    for (Slot& slot : this->slots)
+    {
+        if (slot.state == MAPPED)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        if (slot.fence != 0)
+            glDeleteSync(slot.fence);
+        glDeleteBuffers(1, &slot.buffer);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+
+int AsyncReadback::acquire(size_t size)
+{
+    if (size > this->slot_bytes)
+    {
+        std::cout << "ERROR::ASYNC_READBACK: " << size << " bytes but a slot holds " << this->slot_bytes << std::endl;
+        return -1;
+    }
+    Slot& slot = this->slots[this->head];
+    if (slot.state != FREE)
+        return -1;
+    int index = this->head;
+    this->head = (this->head + 1) % this->slots.size();
+    return index;
+}
+
+
+void AsyncReadback::queued(int index, size_t size, uint64_t tag)
+{
+    Slot& slot = this->slots[index];
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.size = size;
+    slot.tag = tag;
+    slot.state = PENDING;
+}
+
+
+bool AsyncReadback::read_buffer(unsigned int buffer, size_t offset, size_t size, uint64_t tag)
+{
+    int index = this->acquire(size);
+    if (index < 0)
+        return false;
+    Slot& slot = this->slots[index];
+
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, 0, size);
+
+    this->queued(index, size, tag);
+    return true;
+}
+
+
+bool AsyncReadback::read_texture(unsigned int texture, GLenum target, GLenum format, GLenum type, size_t size,
+    uint64_t tag)
+{
+    int index = this->acquire(size);
+    if (index < 0)
+        return false;
+    Slot& slot = this->slots[index];
+
+    glBindTexture(target, texture);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    // with a pack buffer bound the pointer is an offset into it
+    glGetTexImage(target, 0, format, type, (void*)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    this->queued(index, size, tag);
+    return true;
+}
+
+
+bool AsyncReadback::read_framebuffer(unsigned int framebuffer, int x, int y, int width, int height, GLenum format,
+    GLenum type, size_t size, uint64_t tag)
+{
+    int index = this->acquire(size);
+    if (index < 0)
+        return false;
+    Slot& slot = this->slots[index];
+
+    // draws to the framebuffer are ordered before the read, no barrier needed
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glReadPixels(x, y, width, height, format, type, (void*)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    this->queued(index, size, tag);
+    return true;
+}
+
+
+bool AsyncReadback::map_oldest(Span& span, GLuint64 timeout_ns)
+{
+    Slot& slot = this->slots[this->tail];
+    if (slot.state != PENDING)
+        return false;
+
+    // the flush makes sure the fence reaches the GPU, or a zero timeout could poll
+    // forever; no fence left means the copy is done but its map failed last time
+    if (slot.fence != 0)
+    {
+        GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout_ns);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            return false;
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size, GL_MAP_READ_BIT);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (data == NULL)
+    {
+        // the slot stays queued, the next poll() or wait() maps it again
+        std::cout << "ERROR::ASYNC_READBACK::MAP_FAILED: slot " << this->tail << std::endl;
+        return false;
+    }
+    span.data = data;
+    span.size = slot.size;
+    span.tag = slot.tag;
+    span.slot = this->tail;
+    slot.state = MAPPED;
+    this->tail = (this->tail + 1) % this->slots.size();
+    return true;
+}
+
+
+bool AsyncReadback::poll(Span& span)
+{
+    return this->map_oldest(span, 0);
+}
+
+
+bool AsyncReadback::wait(Span& span)
+{
+    // a second at most, a lost context should not hang the caller
+    return this->map_oldest(span, 1000000000ull);
+}
+
+
+void AsyncReadback::release(const Span& span)
+{
+    Slot& slot = this->slots[span.slot];
+    if (slot.state != MAPPED)
+        return;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.state = FREE;
+}
+
+
+int AsyncReadback::pending() const
+{
+    int count = 0;
+    for (const Slot& slot : this->slots)
+        if (slot.state == PENDING)
+            count++;
+    return count;
+}
+
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef AUTO_EXPOSURE_H
+#define AUTO_EXPOSURE_H
+
+#include "glad/glad.h"
+#include "compute_shader.hpp"
+#include "image_format.hpp"
+
+#include <cmath>
+
+
+// Eye adaptation computed entirely on the GPU, from shaders/exposure.comp. A
+// histogram pass counts the texels of the image per bin of log2 luminance with
+// atomics on shared memory, and a single group reduces the histogram to the
+// mean luminance, eases the adapted luminance towards it and writes
+//     struct { float adaptedLuminance; float exposure; }
+// to exposure_buffer(), which the display shader reads as an SSBO
+// (shader.fs with TONE_MAP). Nothing comes back to the CPU, so the exposure
+// lags the image by no frame and the frame never waits on the GPU.
+//
+// The passes use image unit 0 and SSBO binding points 0 and 1; callers rebind
+// their own after an update.
+class AutoExposure
+{
+public:
+    /**
+     * @param format format of the images measured
+     * @param min_log_luminance log2 of the darkest luminance told apart from black
+     * @param log_luminance_range stops covered by the histogram above it
+     * @param shader_path
+     */
+    AutoExposure(const image_format::ImageFormat& format, float min_log_luminance = -8.0f,
+        float log_luminance_range = 12.0f, const char* shader_path = "shaders/exposure.comp");
+    ~AutoExposure();
+
+    // measures texture and adapts over dt seconds; the image must be visible to
+    // image loads and the previous update to shader storage accesses, and the
+    // exposure is left behind no barrier for the shaders reading it
+    // (GL_SHADER_STORAGE_BARRIER_BIT)
+    void update(unsigned int texture, int width, int height, float dt);
+    unsigned int exposure_buffer() const { return this->exposure; }
+    unsigned int histogram_buffer() const { return this->histogram; }
+
+    static const int BIN_COUNT = 256;
+
+    // mid grey the adapted luminance is exposed to
+    float key;
+    // fraction of the gap to the current luminance closed per second, roughly
+    float adaptation_rate;
+
+private:
+    ComputeShader histogram_shader;
+    ComputeShader adapt_shader;
+    const image_format::ImageFormat& format;
+    float min_log_luminance;
+    float log_luminance_range;
+    unsigned int histogram;
+    unsigned int exposure;
+    // the first update snaps to the image instead of fading in from grey
+    bool first;
+};
+
+
+AutoExposure::AutoExposure(const image_format::ImageFormat& format, float min_log_luminance,
+    float log_luminance_range, const char* shader_path) :
+    key(0.18f),
+    adaptation_rate(1.5f),
+    histogram_shader(shader_path, image_format::glsl(format) + "#define EXPOSURE_HISTOGRAM\n"),
+    adapt_shader(shader_path, image_format::glsl(format) + "#define EXPOSURE_ADAPT\n"),
+    format(format),
+    min_log_luminance(min_log_luminance),
+    log_luminance_range(log_luminance_range),
+    first(true)
+{
+    GLuint bins[BIN_COUNT] = {};
+    glGenBuffers(1, &this->histogram);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->histogram);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(bins), bins, GL_DYNAMIC_COPY);
+
+    // exposure 1 until the first update
+    float state[2] = { this->key, 1.0f };
+    glGenBuffers(1, &this->exposure);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->exposure);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(state), state, GL_DYNAMIC_COPY);
+}
+
+
+AutoExposure::~AutoExposure()
+{
+    glDeleteBuffers(1, &this->histogram);
+    glDeleteBuffers(1, &this->exposure);
+    glDeleteProgram(this->histogram_shader.ID);
+    glDeleteProgram(this->adapt_shader.ID);
+}
+
+
+void AutoExposure::update(unsigned int texture, int width, int height, float dt)
+{
+    glBindImageTexture(0, texture, 0, GL_FALSE, 0, GL_READ_ONLY, this->format.internal_format);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, this->histogram);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, this->exposure);
+
+    this->histogram_shader.use();
+    this->histogram_shader.set_float("minLogLuminance", this->min_log_luminance);
+    this->histogram_shader.set_float("logLuminanceRange", this->log_luminance_range);
+    glDispatchCompute((width + 15) / 16, (height + 15) / 16, 1);
+    // the adaptation reads the counts
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    this->adapt_shader.use();
+    this->adapt_shader.set_float("minLogLuminance", this->min_log_luminance);
+    this->adapt_shader.set_float("logLuminanceRange", this->log_luminance_range);
+    this->adapt_shader.set_int("texelCount", width * height);
+    this->adapt_shader.set_float("adaptation", this->first ? 1.0f : 1.0f - std::exp(-dt * this->adaptation_rate));
+    this->adapt_shader.set_float("key", this->key);
+    glDispatchCompute(1, 1, 1);
+    this->first = false;
+}
+
+
+#endif
@@ -40,6 +40,7 @@ public:
     // returns the current camera view matrix
     const glm::mat4 get_view_matrix() const;
     const float get_fov() const;
+    const glm::vec3 get_position() const;
     Camera set_max_fov(float max_fov);
     // moves the camera based off of the input received
     void move(Movement direction, float dt);
@@ -166,6 +167,12 @@ const float cam::Camera::get_fov() const
 }
 
 
+const glm::vec3 cam::Camera::get_position() const
+{
+    return this->position;
+}
+
+
 cam::Camera cam::Camera::set_max_fov(float max_fov)
 {
     this->max_fov = max_fov;
@@ -2,6 +2,7 @@
 #define COMPUTE_SHADER_H
 
 #include "glad/glad.h"
+#include "shader_source.hpp"
 
 #include <glm/glm.hpp>
 #include <string>
@@ -14,7 +15,12 @@ class ComputeShader
 public:
     unsigned int ID;
 
-    ComputeShader(const char* compute_path)
+    /**
+     * @param compute_path
+     * @param defines extra source inserted right after the #version line,
+     * e.g. "#define FAST_PATH\n", to build variants of the same shader
+     */
+    ComputeShader(const char* compute_path, const std::string& defines = "")
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string compute_code;
@@ -39,6 +45,7 @@ public:
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
         }
 
+        compute_code = insert_defines(compute_code, defines);
         const char* shader_code = compute_code.c_str();
 
         unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
@@ -58,6 +65,15 @@ public:
         glUseProgram(this->ID); 
     }
 
+    // dispatches with the DispatchIndirectCommand (num_groups_x, y, z as uints)
+    // found at offset bytes into buffer; the program must be in use and the
+    // writes to the command made visible with GL_COMMAND_BARRIER_BIT
+    void dispatch_indirect(unsigned int buffer, size_t offset = 0) const
+    {
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, buffer);
+        glDispatchComputeIndirect((GLintptr)offset);
+    }
+
 
     // utility uniform functions
     // ------------------------------------------------------------------------
@@ -75,6 +91,10 @@ public:
     { 
         glUniform1f(glGetUniformLocation(this->ID, name.c_str()), value); 
     }
+    void set_float_array(const std::string &name, const float* values, int count) const
+    {
+        glUniform1fv(glGetUniformLocation(this->ID, name.c_str()), count, values);
+    }
     // ------------------------------------------------------------------------
     void set_vec2(const std::string &name, const glm::vec2 &value) const
     { 
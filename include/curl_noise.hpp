@@ -0,0 +1,664 @@
+#ifndef CURL_NOISE_H
+#define CURL_NOISE_H
+
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CURL_NOISE_SSE
+#endif
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+
+
+// CPU port of the curl noise particle kernel of compute_shaders/shaders/particle.comp.
+// Every function is a template over the lane type F, which is either float
+// (one particle) or Lanes4 (four particles in an SSE register), so the scalar
+// and the SIMD paths run the very same sequence of float operations and give
+// bit identical results. The operations also follow the order written in the
+// shader; the GPU output still differs by a few ulps because drivers are free
+// to fuse multiply-adds and to use approximate sqrt/division.
+namespace curl_noise
+{
+
+// lane operations
+// ---------------
+inline float vfloor(float x) { return std::floor(x); }
+inline float vabs(float x) { return std::fabs(x); }
+inline float vsqrt(float x) { return std::sqrt(x); }
+inline float vmin(float a, float b) { return b < a ? b : a; }
+inline float vmax(float a, float b) { return a < b ? b : a; }
+// a < b ? if_true : if_false
+inline float select_less(float a, float b, float if_true, float if_false)
+{
+    return a < b ? if_true : if_false;
+}
+
+
+#ifdef CURL_NOISE_SSE
+struct Lanes4
+{
+    __m128 v;
+
+    Lanes4() : v(_mm_setzero_ps()) { }
+    Lanes4(__m128 v) : v(v) { }
+    Lanes4(float f) : v(_mm_set1_ps(f)) { }
+};
+
+inline Lanes4 operator+(Lanes4 a, Lanes4 b) { return _mm_add_ps(a.v, b.v); }
+inline Lanes4 operator-(Lanes4 a, Lanes4 b) { return _mm_sub_ps(a.v, b.v); }
+inline Lanes4 operator*(Lanes4 a, Lanes4 b) { return _mm_mul_ps(a.v, b.v); }
+inline Lanes4 operator/(Lanes4 a, Lanes4 b) { return _mm_div_ps(a.v, b.v); }
+inline Lanes4 operator-(Lanes4 a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+
+inline Lanes4 vfloor(Lanes4 x)
+{
+#ifdef __SSE4_1__
+    return _mm_floor_ps(x.v);
+#else
+    // truncate, then step down where truncation rounded up; exact for |x| < 2^31,
+    // far above anything the kernel produces
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x.v));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x.v), _mm_set1_ps(1.0f)));
+#endif
+}
+inline Lanes4 vabs(Lanes4 x) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), x.v); }
+inline Lanes4 vsqrt(Lanes4 x) { return _mm_sqrt_ps(x.v); }
+inline Lanes4 vmin(Lanes4 a, Lanes4 b) { return _mm_min_ps(b.v, a.v); }
+inline Lanes4 vmax(Lanes4 a, Lanes4 b) { return _mm_max_ps(b.v, a.v); }
+inline Lanes4 select_less(Lanes4 a, Lanes4 b, Lanes4 if_true, Lanes4 if_false)
+{
+    __m128 mask = _mm_cmplt_ps(a.v, b.v);
+    return _mm_or_ps(_mm_and_ps(mask, if_true.v), _mm_andnot_ps(mask, if_false.v));
+}
+#endif
+
+
+template<typename F>
+struct Vec3
+{
+    F x, y, z;
+};
+
+template<typename F>
+Vec3<F> operator+(const Vec3<F>& a, const Vec3<F>& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+template<typename F>
+Vec3<F> operator-(const Vec3<F>& a, const Vec3<F>& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+template<typename F>
+Vec3<F> operator*(const Vec3<F>& a, F s) { return { a.x * s, a.y * s, a.z * s }; }
+template<typename F>
+Vec3<F> operator*(F s, const Vec3<F>& a) { return { s * a.x, s * a.y, s * a.z }; }
+
+template<typename F>
+F dot(const Vec3<F>& a, const Vec3<F>& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+template<typename F>
+Vec3<F> normalize(const Vec3<F>& v)
+{
+    F inv_length = F(1.0f) / vsqrt(dot(v, v));
+    return v * inv_length;
+}
+
+// GLSL step(edge, x)
+template<typename F>
+F step(F edge, F x)
+{
+    return select_less(x, edge, F(0.0f), F(1.0f));
+}
+
+
+// simplex noise
+// -------------
+template<typename F>
+F mod289(F x)
+{
+    return x - vfloor(x * F(1.0f / 289.0f)) * F(289.0f);
+}
+
+template<typename F>
+F permute(F x)
+{
+    return mod289(((x * F(34.0f)) + F(1.0f)) * x);
+}
+
+/**
+ * @brief Contribution of one simplex corner: the shader computes the four
+ * corners at once in vec4 lanes, here they are unrolled.
+ *
+ * @param i simplex cell, already reduced mod 289
+ * @param o corner offset inside the cell
+ * @param x position relative to the corner
+ * @param gradient if not null, the gradient of the contribution is added to it
+ * @return F
+ */
+template<typename F>
+F simplex_corner(const Vec3<F>& i, const Vec3<F>& o, const Vec3<F>& x, Vec3<F>* gradient)
+{
+    const float n_ = 0.142857142857f; // 1.0/7.0
+    const F ns_x = F(n_ * 2.0f - 0.0f);
+    const F ns_y = F(n_ * 0.5f - 1.0f);
+    const F ns_z = F(n_ * 1.0f - 0.0f);
+
+    F p = permute(permute(permute(i.z + o.z) + i.y + o.y) + i.x + o.x);
+
+    F j = p - F(49.0f) * vfloor(p * ns_z * ns_z);
+    F x_ = vfloor(j * ns_z);
+    F y_ = vfloor(j - F(7.0f) * x_);
+
+    F gx = x_ * ns_x + ns_y;
+    F gy = y_ * ns_x + ns_y;
+    F h = F(1.0f) - vabs(gx) - vabs(gy);
+
+    F sx = vfloor(gx) * F(2.0f) + F(1.0f);
+    F sy = vfloor(gy) * F(2.0f) + F(1.0f);
+    F sh = -step(h, F(0.0f));
+
+    Vec3<F> g = { gx + sx * sh, gy + sy * sh, h };
+    F norm = F(1.79284291400159f) - F(0.85373472095314f) * dot(g, g);
+    g = g * norm;
+
+    F m = vmax(F(0.6f) - dot(x, x), F(0.0f));
+    F m2 = m * m;
+    F m4 = m2 * m2;
+    F gdotx = dot(g, x);
+
+    if (gradient != nullptr)
+    {
+        // d(m^4 * dot(g, x)) / dx = m^4 * g - 8 * m^3 * dot(g, x) * x
+        F temp = m2 * m * gdotx;
+        *gradient = *gradient + m4 * g - (F(8.0f) * temp) * x;
+    }
+    return m4 * gdotx;
+}
+
+/**
+ * @brief Simplex noise, and its gradient with respect to v when gradient is not null.
+ *
+ * @param v
+ * @param gradient
+ * @return F
+ */
+template<typename F>
+F snoise_grad(const Vec3<F>& v, Vec3<F>* gradient)
+{
+    const F Cx = F(1.0f / 6.0f);
+    const F Cy = F(1.0f / 3.0f);
+
+    // first corner
+    F s = v.x * Cy + v.y * Cy + v.z * Cy;
+    Vec3<F> i = { vfloor(v.x + s), vfloor(v.y + s), vfloor(v.z + s) };
+    F u = i.x * Cx + i.y * Cx + i.z * Cx;
+    Vec3<F> x0 = { v.x - i.x + u, v.y - i.y + u, v.z - i.z + u };
+
+    // other corners
+    Vec3<F> g = { step(x0.y, x0.x), step(x0.z, x0.y), step(x0.x, x0.z) };
+    Vec3<F> l = { F(1.0f) - g.x, F(1.0f) - g.y, F(1.0f) - g.z };
+    Vec3<F> i1 = { vmin(g.x, l.z), vmin(g.y, l.x), vmin(g.z, l.y) };
+    Vec3<F> i2 = { vmax(g.x, l.z), vmax(g.y, l.x), vmax(g.z, l.y) };
+
+    Vec3<F> x1 = { x0.x - i1.x + Cx, x0.y - i1.y + Cx, x0.z - i1.z + Cx };
+    Vec3<F> x2 = { x0.x - i2.x + Cy, x0.y - i2.y + Cy, x0.z - i2.z + Cy };
+    Vec3<F> x3 = { x0.x - F(0.5f), x0.y - F(0.5f), x0.z - F(0.5f) };
+
+    i = { mod289(i.x), mod289(i.y), mod289(i.z) };
+    const Vec3<F> zero = { F(0.0f), F(0.0f), F(0.0f) };
+    const Vec3<F> one = { F(1.0f), F(1.0f), F(1.0f) };
+
+    if (gradient != nullptr)
+        *gradient = zero;
+    F n0 = simplex_corner(i, zero, x0, gradient);
+    F n1 = simplex_corner(i, i1, x1, gradient);
+    F n2 = simplex_corner(i, i2, x2, gradient);
+    F n3 = simplex_corner(i, one, x3, gradient);
+    if (gradient != nullptr)
+        *gradient = F(42.0f) * *gradient;
+    return F(42.0f) * (n0 + n1 + n2 + n3);
+}
+
+template<typename F>
+F snoise(const Vec3<F>& v)
+{
+    return snoise_grad<F>(v, nullptr);
+}
+
+template<typename F>
+Vec3<F> noise3d(const Vec3<F>& s)
+{
+    F s0 = snoise(s);
+    F s1 = snoise(Vec3<F>{ s.y + F(31.416f), s.z - F(47.853f), s.x + F(12.793f) });
+    F s2 = snoise(Vec3<F>{ s.z - F(233.145f), s.x - F(113.408f), s.y - F(185.31f) });
+    return { s0, s1, s2 };
+}
+
+
+// potential field around the sphere
+// ---------------------------------
+const float SPHERE_RADIUS = 0.5f;
+
+// pow() is undefined in GLSL for negative bases and r < 0 inside the sphere,
+// so the powers are spelled out here and in the shader
+template<typename F>
+F ramp(F r)
+{
+    F r3 = r * r * r;
+    F r5 = r3 * r * r;
+    F v = (F(15.0f) * r - F(10.0f) * r3 + F(3.0f) * r5) / F(8.0f);
+    return vmin(vmax(v, F(-1.0f)), F(1.0f));
+}
+
+// the sphere is centred at the origin
+template<typename F>
+F sphere_sdf(const Vec3<F>& p)
+{
+    return vsqrt(dot(p, p)) - F(SPHERE_RADIUS);
+}
+
+template<typename F>
+Vec3<F> gradient(const Vec3<F>& p)
+{
+    const F e = F(0.01f);
+
+    F d = sphere_sdf(p);
+    F dfdx = sphere_sdf(Vec3<F>{ p.x + e, p.y, p.z }) - d;
+    F dfdy = sphere_sdf(Vec3<F>{ p.x, p.y + e, p.z }) - d;
+    F dfdz = sphere_sdf(Vec3<F>{ p.x, p.y, p.z + e }) - d;
+
+    return normalize(Vec3<F>{ dfdx, dfdy, dfdz });
+}
+
+template<typename F>
+Vec3<F> potential(const Vec3<F>& p)
+{
+    Vec3<F> grad = gradient(p);
+    F dist = sphere_sdf(p);
+    F alpha = vabs(ramp(dist));
+
+    Vec3<F> rpsi = { F(2.0f) * p.z, F(0.0f), F(-2.0f) * p.x };
+
+    Vec3<F> psi = noise3d(p) + rpsi;
+    F normal = dot(psi, grad);
+    return alpha * psi + ((F(1.0f) - alpha) * normal) * grad;
+}
+
+// how curl() differentiates the potential
+enum CurlMethod
+{
+    // exact jacobian from the noise gradients, the default of particle.comp
+    ANALYTIC,
+    // central differences, particle.comp built with CURL_FINITE_DIFFERENCE
+    FINITE_DIFFERENCE
+};
+
+template<typename F>
+Vec3<F> curl_finite_difference(const Vec3<F>& p)
+{
+    const F e = F(0.0001f);
+
+    Vec3<F> px0 = potential(Vec3<F>{ p.x + e, p.y, p.z });
+    Vec3<F> px1 = potential(Vec3<F>{ p.x - e, p.y, p.z });
+    Vec3<F> py0 = potential(Vec3<F>{ p.x, p.y + e, p.z });
+    Vec3<F> py1 = potential(Vec3<F>{ p.x, p.y - e, p.z });
+    Vec3<F> pz0 = potential(Vec3<F>{ p.x, p.y, p.z + e });
+    Vec3<F> pz1 = potential(Vec3<F>{ p.x, p.y, p.z - e });
+
+    F x = py0.z - py1.z - pz0.y + pz1.y;
+    F y = pz0.x - pz1.x - px0.z + px1.z;
+    F z = px0.y - px1.y - py0.x + py1.x;
+
+    F two_e = F(2.0f) * e;
+    return normalize(Vec3<F>{ x / two_e, y / two_e, z / two_e });
+}
+
+template<typename F>
+F ramp_derivative(F r)
+{
+    // the ramp is clamped at |r| >= 1, where its derivative also reaches 0
+    F r2 = r * r;
+    F d = (F(15.0f) - F(30.0f) * r2 + F(15.0f) * r2 * r2) / F(8.0f);
+    return select_less(vabs(r), F(1.0f), d, F(0.0f));
+}
+
+// GLSL sign(x)
+template<typename F>
+F sign(F x)
+{
+    return select_less(F(0.0f), x, F(1.0f), select_less(x, F(0.0f), F(-1.0f), F(0.0f)));
+}
+
+/**
+ * @brief Curl of potential() from its exact jacobian: 3 noise samples with
+ * gradients and the closed form normal of the sphere.
+ *
+ * @param p
+ * @return Vec3<F>
+ */
+template<typename F>
+Vec3<F> curl_analytic(const Vec3<F>& p)
+{
+    // noise and its jacobian, noise3d() samples permuted coordinates;
+    // rows[i] is the gradient of the i-th component of the potential
+    Vec3<F> g0, g1, g2;
+    F s0 = snoise_grad(p, &g0);
+    F s1 = snoise_grad(Vec3<F>{ p.y + F(31.416f), p.z - F(47.853f), p.x + F(12.793f) }, &g1);
+    F s2 = snoise_grad(Vec3<F>{ p.z - F(233.145f), p.x - F(113.408f), p.y - F(185.31f) }, &g2);
+
+    Vec3<F> psi = { s0 + F(2.0f) * p.z, s1, s2 + F(-2.0f) * p.x };
+    const Vec3<F> rows[3] = {
+        { g0.x, g0.y, g0.z + F(2.0f) },
+        { g1.z, g1.x, g1.y },
+        { g2.y + F(-2.0f), g2.z, g2.x },
+    };
+
+    // sphere normal n = p / |p| and its jacobian (I - n n^T) / |p|
+    F len = vmax(vsqrt(dot(p, p)), F(1e-6f));
+    Vec3<F> n = { p.x / len, p.y / len, p.z / len };
+    F dist = len - F(SPHERE_RADIUS);
+
+    F r = ramp(dist);
+    F alpha = vabs(r);
+    Vec3<F> grad_alpha = (sign(r) * ramp_derivative(dist)) * n;
+
+    // psi_const = alpha * psi + (1 - alpha) * dot(psi, n) * n
+    F normal = dot(psi, n);
+    Vec3<F> tangent = psi - normal * n;
+    Vec3<F> grad_normal = n.x * rows[0] + n.y * rows[1] + n.z * rows[2]
+        + Vec3<F>{ tangent.x / len, tangent.y / len, tangent.z / len };
+
+    const F psi_i[3] = { psi.x, psi.y, psi.z };
+    const F n_i[3] = { n.x, n.y, n.z };
+    Vec3<F> J[3];
+    for (int i = 0; i < 3; i++)
+    {
+        Vec3<F> unit = { F(i == 0 ? 1.0f : 0.0f), F(i == 1 ? 1.0f : 0.0f), F(i == 2 ? 1.0f : 0.0f) };
+        Vec3<F> grad_n = unit - n_i[i] * n;
+        grad_n = Vec3<F>{ grad_n.x / len, grad_n.y / len, grad_n.z / len };
+        J[i] = psi_i[i] * grad_alpha + alpha * rows[i]
+            - (normal * n_i[i]) * grad_alpha
+            + (F(1.0f) - alpha) * (n_i[i] * grad_normal + normal * grad_n);
+    }
+
+    return normalize(Vec3<F>{ J[2].y - J[1].z, J[0].z - J[2].x, J[1].x - J[0].y });
+}
+
+template<typename F>
+Vec3<F> curl(const Vec3<F>& p, CurlMethod method = ANALYTIC)
+{
+    if (method == FINITE_DIFFERENCE)
+        return curl_finite_difference(p);
+    return curl_analytic(p);
+}
+
+
+/**
+ * @brief Curl field baked on a regular grid, the CPU side of the curl volume
+ * of particle.comp. Voxel centres sit at min + (index + 0.5) / size * (max - min)
+ * and samples outside the box clamp to the border voxels, like a GL_TEXTURE_3D
+ * with GL_CLAMP_TO_EDGE.
+ */
+struct CurlVolume
+{
+    int size[3];
+    float min[3];
+    float max[3];
+    // trilinear (GL_LINEAR) or nearest (GL_NEAREST) sampling
+    bool linear;
+    // rgba per voxel with x varying fastest, the layout of glTexImage3D
+    std::vector<float> data;
+};
+
+/**
+ * @brief Creates an empty volume covering [min, max].
+ *
+ * @param size_x
+ * @param size_y
+ * @param size_z
+ * @param min
+ * @param max
+ * @param linear
+ * @return CurlVolume
+ */
+CurlVolume make_volume(int size_x, int size_y, int size_z, const float min[3], const float max[3],
+    bool linear = true)
+{
+    CurlVolume volume;
+    volume.size[0] = size_x;
+    volume.size[1] = size_y;
+    volume.size[2] = size_z;
+    for (int k = 0; k < 3; k++)
+    {
+        volume.min[k] = min[k];
+        volume.max[k] = max[k];
+    }
+    volume.linear = linear;
+    volume.data.assign((size_t)size_x * size_y * size_z * 4, 0.0f);
+    return volume;
+}
+
+/**
+ * @brief Evaluates the curl at every voxel centre, one z slice row per job.
+ *
+ * @param volume
+ * @param pool runs inline if null
+ * @param method
+ */
+void bake_volume(CurlVolume& volume, ThreadPool* pool = nullptr, CurlMethod method = ANALYTIC)
+{
+    const int* size = volume.size;
+    auto bake_rows = [&](size_t first, size_t last) {
+        for (size_t row = first; row < last; row++)
+        {
+            int y = row % size[1];
+            int z = row / size[1];
+            for (int x = 0; x < size[0]; x++)
+            {
+                int voxel[3] = { x, y, z };
+                float p[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    float u = (voxel[k] + 0.5f) / size[k];
+                    p[k] = volume.min[k] + (volume.max[k] - volume.min[k]) * u;
+                }
+                Vec3<float> c = curl(Vec3<float>{ p[0], p[1], p[2] }, method);
+                float* out = &volume.data[(((size_t)z * size[1] + y) * size[0] + x) * 4];
+                out[0] = c.x;
+                out[1] = c.y;
+                out[2] = c.z;
+                out[3] = 0.0f;
+            }
+        }
+    };
+
+    size_t rows = (size_t)size[1] * size[2];
+    if (pool == nullptr)
+        bake_rows(0, rows);
+    else
+        pool->parallel_for(0, rows, 4, bake_rows);
+}
+
+/**
+ * @brief Samples the volume at p, normalizing the interpolated vector.
+ *
+ * @param volume
+ * @param p
+ * @return Vec3<float>
+ */
+Vec3<float> sample_volume(const CurlVolume& volume, const Vec3<float>& p)
+{
+    const float coords[3] = { p.x, p.y, p.z };
+    int i0[3], i1[3];
+    float w[3];
+    for (int k = 0; k < 3; k++)
+    {
+        // texel space, texel centres at integer coordinates
+        float u = (coords[k] - volume.min[k]) / (volume.max[k] - volume.min[k]) * volume.size[k];
+        int last = volume.size[k] - 1;
+        if (volume.linear)
+        {
+            float texel = u - 0.5f;
+            float base = std::floor(texel);
+            w[k] = texel - base;
+            i0[k] = std::min(std::max((int)base, 0), last);
+            i1[k] = std::min(std::max((int)base + 1, 0), last);
+        }
+        else
+        {
+            i0[k] = i1[k] = std::min(std::max((int)std::floor(u), 0), last);
+            w[k] = 0.0f;
+        }
+    }
+
+    float v[3] = { 0.0f, 0.0f, 0.0f };
+    for (int corner = 0; corner < 8; corner++)
+    {
+        int x = corner & 1 ? i1[0] : i0[0];
+        int y = corner & 2 ? i1[1] : i0[1];
+        int z = corner & 4 ? i1[2] : i0[2];
+        float weight = (corner & 1 ? w[0] : 1.0f - w[0])
+            * (corner & 2 ? w[1] : 1.0f - w[1])
+            * (corner & 4 ? w[2] : 1.0f - w[2]);
+        const float* texel = &volume.data[(((size_t)z * volume.size[1] + y) * volume.size[0] + x) * 4];
+        for (int k = 0; k < 3; k++)
+            v[k] += weight * texel[k];
+    }
+
+    // interpolated unit vectors are shorter than 1, the guard keeps a zero vector finite
+    Vec3<float> speed = { v[0], v[1], v[2] };
+    return speed * (1.0f / std::sqrt(std::max(dot(speed, speed), 1e-12f)));
+}
+
+
+// how update_particles() computes the particle velocities
+struct KernelOptions
+{
+    // process 4 particles per iteration when SSE is available
+    bool simd = true;
+    CurlMethod method = ANALYTIC;
+    // sample this baked field instead of evaluating the noise
+    const CurlVolume* volume = nullptr;
+};
+
+
+/**
+ * @brief Moves the particle along speed and respawns it at the bottom once it
+ * leaves the top of the screen.
+ *
+ * @param x
+ * @param y
+ * @param spawn_x x position the particle respawns at
+ * @param speed
+ */
+template<typename F>
+void move_particle(F& x, F& y, F spawn_x, const Vec3<F>& speed)
+{
+    x = x + speed.x / F(20.0f);
+    y = y + speed.y / F(20.0f);
+
+    x = select_less(F(1.0f), y, spawn_x, x);
+    y = select_less(F(1.0f), y, F(-1.0f), y);
+}
+
+/**
+ * @brief One step of the particle kernel with the curl evaluated from the noise.
+ *
+ * @param x
+ * @param y
+ * @param spawn_x
+ * @param t time coordinate of the noise
+ * @param method
+ */
+template<typename F>
+void step_particle(F& x, F& y, F spawn_x, float t, CurlMethod method = ANALYTIC)
+{
+    move_particle(x, y, spawn_x, curl(Vec3<F>{ x, y, F(t) }, method));
+}
+
+
+/**
+ * @brief Advances particles [first, last) by one step.
+ *
+ * @param positions interleaved xy positions, updated in place
+ * @param initial_positions interleaved xy spawn positions
+ * @param first
+ * @param last
+ * @param t
+ * @param options
+ */
+void update_range(float* positions, const float* initial_positions,
+    size_t first, size_t last, float t, const KernelOptions& options = KernelOptions())
+{
+    size_t i = first;
+
+    if (options.volume != nullptr)
+    {
+        for (; i < last; i++)
+        {
+            Vec3<float> speed = sample_volume(*options.volume, Vec3<float>{ positions[2 * i], positions[2 * i + 1], t });
+            move_particle(positions[2 * i], positions[2 * i + 1], initial_positions[2 * i], speed);
+        }
+        return;
+    }
+
+#ifdef CURL_NOISE_SSE
+    if (options.simd)
+    {
+        for (; i + 4 <= last; i += 4)
+        {
+            __m128 a = _mm_loadu_ps(positions + 2 * i);
+            __m128 b = _mm_loadu_ps(positions + 2 * i + 4);
+            __m128 sa = _mm_loadu_ps(initial_positions + 2 * i);
+            __m128 sb = _mm_loadu_ps(initial_positions + 2 * i + 4);
+
+            Lanes4 x = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            Lanes4 y = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            Lanes4 spawn_x = _mm_shuffle_ps(sa, sb, _MM_SHUFFLE(2, 0, 2, 0));
+
+            step_particle(x, y, spawn_x, t, options.method);
+
+            _mm_storeu_ps(positions + 2 * i, _mm_unpacklo_ps(x.v, y.v));
+            _mm_storeu_ps(positions + 2 * i + 4, _mm_unpackhi_ps(x.v, y.v));
+        }
+    }
+#endif
+
+    for (; i < last; i++)
+        step_particle(positions[2 * i], positions[2 * i + 1], initial_positions[2 * i], t, options.method);
+}
+
+
+/**
+ * @brief Advances count particles by one step, same as one dispatch of particle.comp.
+ *
+ * @param positions interleaved xy positions, updated in place
+ * @param initial_positions interleaved xy spawn positions
+ * @param count
+ * @param t
+ * @param pool splits the particles over the pool threads, runs inline if null
+ * @param options
+ */
+void update_particles(float* positions, const float* initial_positions, size_t count,
+    float t, ThreadPool* pool = nullptr, const KernelOptions& options = KernelOptions())
+{
+    if (pool == nullptr)
+    {
+        update_range(positions, initial_positions, 0, count, t, options);
+        return;
+    }
+    pool->parallel_for(0, count, 256, [&](size_t first, size_t last) {
+        update_range(positions, initial_positions, first, last, t, options);
+    });
+}
+
+
+}; // namespace curl_noise
+
+
+#endif
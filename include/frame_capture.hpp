@@ -0,0 +1,262 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include "glad/glad.h"
+#include "async_readback.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// Records the frames of a window or an FBO to a video stream, without ever
+// blocking the render loop on I/O. Frames are read back through an
+// AsyncReadback ring, copied out of the mapped pack buffer into a bounded queue
+// and written by a thread of their own. When the GPU or the disk falls behind,
+// frames are dropped and counted rather than waited for.
+//
+// Formats, picked from the path:
+//     *.y4m  YUV4MPEG2, 4:2:0 BT.601, plays in ffplay/mpv and encodes with ffmpeg -i x.y4m
+//     other  raw top-down RGBA8, for ffmpeg -f rawvideo -pixel_format rgba -video_size WxH -framerate F -i x
+// A path of "-" streams to stdout, e.g. into ffmpeg -i -; everything else
+// printed to stdout would end up in the video, so the caller moves std::cout to
+// stderr first.
+//
+// The size is fixed at construction, so a window being captured must not be
+// resizable (GLFW_RESIZABLE): the pixels past a shrunk framebuffer are undefined.
+class FrameCapture
+{
+public:
+    enum Format
+    {
+        Y4M,
+        RAW
+    };
+
+    // fps is only written in the Y4M header, frames are taken as they are captured
+    FrameCapture(const std::string& path, int width, int height, int fps = 60, int queue_frames = 8);
+    // waits for the frames in flight and the writer, and prints how many frames were kept
+    ~FrameCapture();
+
+    bool is_open() const;
+    // queues a readback of the read buffer of framebuffer (0: the back buffer of
+    // the window); call it after drawing and before swapping buffers
+    void capture(unsigned int framebuffer = 0);
+
+    static Format format_of(const std::string& path);
+
+    int width;
+    int height;
+    Format format;
+
+private:
+    // moves finished readbacks to the writer queue, waiting for them with wait
+    void collect(bool wait);
+    void writer_loop();
+    void write_frame(const std::vector<uint8_t>& rgba);
+
+    FILE* file;
+    AsyncReadback readback;
+    uint64_t frame_index;
+    uint64_t frames_written;
+    uint64_t frames_dropped;
+
+    // frames waiting for the writer, and buffers to reuse for the next ones
+    std::deque<std::vector<uint8_t>> queue;
+    std::vector<std::vector<uint8_t>> free_frames;
+    size_t queue_frames;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+    std::thread writer;
+
+    // writer thread scratch for the Y4M planes
+    std::vector<uint8_t> planes;
+};
+
+
+FrameCapture::FrameCapture(const std::string& path, int width, int height, int fps, int queue_frames) :
+    width(width), height(height), format(format_of(path)), file(NULL),
+    readback((size_t)width * height * 4), frame_index(0), frames_written(0), frames_dropped(0),
+    queue_frames(queue_frames), stopping(false)
+{
+    if (path == "-")
+        this->file = stdout;
+    else
+        this->file = std::fopen(path.c_str(), "wb");
+    if (this->file == NULL)
+    {
+        std::cout << "ERROR::FRAME_CAPTURE::CANNOT_OPEN: " << path << std::endl;
+        return;
+    }
+
+    if (this->format == Y4M)
+        std::fprintf(this->file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+    this->writer = std::thread(&FrameCapture::writer_loop, this);
+}
+
+
+FrameCapture::~FrameCapture()
+{
+    if (this->file == NULL)
+        return;
+
+    // the readbacks in flight still belong to the capture
+    this->collect(true);
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->wake.notify_all();
+    this->writer.join();
+
+    if (this->file == stdout)
+        std::fflush(this->file);
+    else
+        std::fclose(this->file);
+    std::cout << "captured " << this->frames_written << " frames, " << this->frames_dropped << " dropped" << std::endl;
+}
+
+
+bool FrameCapture::is_open() const
+{
+    return this->file != NULL;
+}
+
+
+FrameCapture::Format FrameCapture::format_of(const std::string& path)
+{
+    const std::string extension = ".y4m";
+    if (path.size() >= extension.size() && path.compare(path.size() - extension.size(), extension.size(), extension) == 0)
+        return Y4M;
+    return RAW;
+}
+
+
+void FrameCapture::capture(unsigned int framebuffer)
+{
+    if (this->file == NULL)
+        return;
+
+    this->collect(false);
+    if (!this->readback.read_framebuffer(framebuffer, 0, 0, this->width, this->height, GL_RGBA, GL_UNSIGNED_BYTE,
+        (size_t)this->width * this->height * 4, this->frame_index))
+        this->frames_dropped++;
+    this->frame_index++;
+}
+
+
+void FrameCapture::collect(bool wait)
+{
+    Span span;
+    while (wait ? this->readback.wait(span) : this->readback.poll(span))
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (this->queue.size() < this->queue_frames)
+            {
+                std::vector<uint8_t> frame;
+                if (!this->free_frames.empty())
+                {
+                    frame.swap(this->free_frames.back());
+                    this->free_frames.pop_back();
+                }
+                frame.assign(span.as<uint8_t>(), span.as<uint8_t>() + span.size);
+                this->queue.push_back(std::move(frame));
+            }
+            else
+                this->frames_dropped++;
+        }
+        this->wake.notify_one();
+        this->readback.release(span);
+    }
+}
+
+
+void FrameCapture::writer_loop()
+{
+    while (true)
+    {
+        std::vector<uint8_t> frame;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->wake.wait(lock, [this] { return this->stopping || !this->queue.empty(); });
+            // the queue is drained before stopping
+            if (this->queue.empty())
+                return;
+            frame.swap(this->queue.front());
+            this->queue.pop_front();
+        }
+
+        this->write_frame(frame);
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->frames_written++;
+        this->free_frames.push_back(std::move(frame));
+    }
+}
+
+
+void FrameCapture::write_frame(const std::vector<uint8_t>& rgba)
+{
+    int w = this->width;
+    int h = this->height;
+    // GL rows start at the bottom of the image, video rows at the top
+    auto row = [&](int y) { return &rgba[(size_t)(h - 1 - y) * w * 4]; };
+
+    if (this->format == RAW)
+    {
+        for (int y = 0; y < h; y++)
+            std::fwrite(row(y), 1, (size_t)w * 4, this->file);
+        return;
+    }
+
+    // BT.601 limited range; chroma is the mean of each 2x2 block, odd sizes
+    // repeat the last row and column
+    int cw = (w + 1) / 2;
+    int ch = (h + 1) / 2;
+    this->planes.resize((size_t)w * h + 2 * (size_t)cw * ch);
+    uint8_t* Y = this->planes.data();
+    uint8_t* U = Y + (size_t)w * h;
+    uint8_t* V = U + (size_t)cw * ch;
+    for (int y = 0; y < h; y++)
+    {
+        const uint8_t* p = row(y);
+        for (int x = 0; x < w; x++, p += 4)
+            Y[(size_t)y * w + x] = (uint8_t)(16.5f + 0.257f * p[0] + 0.504f * p[1] + 0.098f * p[2]);
+    }
+    for (int cy = 0; cy < ch; cy++)
+    {
+        const uint8_t* rows[2] = { row(2 * cy), row(std::min(2 * cy + 1, h - 1)) };
+        for (int cx = 0; cx < cw; cx++)
+        {
+            int xs[2] = { 2 * cx, std::min(2 * cx + 1, w - 1) };
+            float r = 0.0f, g = 0.0f, b = 0.0f;
+            for (const uint8_t* rr : rows)
+                for (int x : xs)
+                {
+                    r += rr[x * 4];
+                    g += rr[x * 4 + 1];
+                    b += rr[x * 4 + 2];
+                }
+            r *= 0.25f;
+            g *= 0.25f;
+            b *= 0.25f;
+            U[(size_t)cy * cw + cx] = (uint8_t)(128.5f - 0.148f * r - 0.291f * g + 0.439f * b);
+            V[(size_t)cy * cw + cx] = (uint8_t)(128.5f + 0.439f * r - 0.368f * g - 0.071f * b);
+        }
+    }
+    std::fputs("FRAME\n", this->file);
+    std::fwrite(this->planes.data(), 1, this->planes.size(), this->file);
+}
+
+
+#endif
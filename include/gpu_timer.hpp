@@ -0,0 +1,69 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include "glad/glad.h"
+
+#include <cstdint>
+
+
+// Measures the GPU time spent by the commands issued between begin() and end()
+// with a GL_TIME_ELAPSED query. Timer queries cannot be nested.
+class GpuTimer
+{
+public:
+    GpuTimer();
+    ~GpuTimer();
+
+    void begin();
+    void end();
+    // true once the result of the last begin()/end() pair can be read without stalling
+    bool available() const;
+    // elapsed time of the last begin()/end() pair, waits for the GPU if needed
+    double elapsed_ms() const;
+
+private:
+    unsigned int query;
+};
+
+
+GpuTimer::GpuTimer()
+{
+    glGenQueries(1, &this->query);
+}
+
+
+GpuTimer::~GpuTimer()
+{
+    glDeleteQueries(1, &this->query);
+}
+
+
+void GpuTimer::begin()
+{
+    glBeginQuery(GL_TIME_ELAPSED, this->query);
+}
+
+
+void GpuTimer::end()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+}
+
+
+bool GpuTimer::available() const
+{
+    GLint ready = 0;
+    glGetQueryObjectiv(this->query, GL_QUERY_RESULT_AVAILABLE, &ready);
+    return ready != 0;
+}
+
+
+double GpuTimer::elapsed_ms() const
+{
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(this->query, GL_QUERY_RESULT, &ns);
+    return ns / 1.0e6;
+}
+
+
+#endif
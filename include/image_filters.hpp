@@ -0,0 +1,204 @@
+#ifndef IMAGE_FILTERS_H
+#define IMAGE_FILTERS_H
+
+#include "glad/glad.h"
+#include "compute_shader.hpp"
+#include "image_format.hpp"
+#include "workgroup_tuner.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+
+// Post-processing filters of shaders/filters.comp, from one image to another of
+// the same size and format: separable Gaussian blur and box filter, Sobel edges
+// and any 3x3 or 5x5 kernel. Every group loads its tile and the apron around it
+// into shared memory once, then all taps read from there, so a texel is fetched
+// about once per pass instead of once per tap that reaches it; naive kernels of
+// an imageLoad per tap are bandwidth bound at these sizes.
+//
+// The source must be visible to image loads when a filter is called (a
+// GL_SHADER_IMAGE_ACCESS_BARRIER_BIT after the pass that wrote it) and the
+// destination is left behind no barrier, as for a pass of the pass graph.
+// Variants are compiled the first time they are used.
+class ImageFilters
+{
+public:
+    // largest radius of the separable filters, the apron of the tile
+    static const int MAX_RADIUS = 16;
+
+    /**
+     * @param format format of the images filtered
+     * @param tiled false for the variants reading every tap with imageLoad, to compare
+     * @param local_size group shape, also the tile size
+     * @param shader_path
+     */
+    ImageFilters(const image_format::ImageFormat& format, bool tiled = true,
+        const LocalSize& local_size = { 16, 16, 1 }, const char* shader_path = "shaders/filters.comp");
+    ~ImageFilters();
+
+    // separable Gaussian of radius ceil(3 sigma), rows into scratch then columns
+    // into destination
+    void gaussian(unsigned int source, unsigned int scratch, unsigned int destination, int width, int height,
+        float sigma);
+    // mean of the (2 radius + 1)^2 texels around each one, in two passes as gaussian()
+    void box(unsigned int source, unsigned int scratch, unsigned int destination, int width, int height,
+        int radius);
+    // gradient magnitude of the luminance, in grey
+    void sobel(unsigned int source, unsigned int destination, int width, int height);
+    // 9 or 25 weights, row major; the alpha is copied
+    void convolve(unsigned int source, unsigned int destination, int width, int height,
+        const std::vector<float>& kernel);
+
+    // 2 radius + 1 normalised weights, radius ceil(3 sigma) up to MAX_RADIUS
+    static std::vector<float> gaussian_weights(float sigma);
+
+    const image_format::ImageFormat& format;
+    bool tiled;
+    LocalSize local_size;
+
+private:
+    ComputeShader& variant(const std::string& defines);
+    void separable(unsigned int source, unsigned int scratch, unsigned int destination, int width, int height,
+        const std::vector<float>& weights);
+    // binds source to unit 0, destination to unit 1 and dispatches over the image
+    void pass(ComputeShader& shader, unsigned int source, unsigned int destination, int width, int height);
+
+    std::string shader_path;
+    std::map<std::string, ComputeShader*> shaders;
+};
+
+
+ImageFilters::ImageFilters(const image_format::ImageFormat& format, bool tiled, const LocalSize& local_size,
+    const char* shader_path) :
+    format(format), tiled(tiled), local_size(local_size), shader_path(shader_path)
+{
+}
+
+
+ImageFilters::~ImageFilters()
+{
+    for (auto& entry : this->shaders)
+    {
+        glDeleteProgram(entry.second->ID);
+        delete entry.second;
+    }
+}
+
+
+void ImageFilters::gaussian(unsigned int source, unsigned int scratch, unsigned int destination, int width,
+    int height, float sigma)
+{
+    this->separable(source, scratch, destination, width, height, gaussian_weights(sigma));
+}
+
+
+void ImageFilters::box(unsigned int source, unsigned int scratch, unsigned int destination, int width,
+    int height, int radius)
+{
+    if (radius < 1 || radius > MAX_RADIUS)
+    {
+        std::cout << "ERROR::IMAGE_FILTERS::RADIUS_OUT_OF_RANGE: " << radius << std::endl;
+        radius = std::min(std::max(radius, 1), (int)MAX_RADIUS);
+    }
+    std::vector<float> weights(2 * radius + 1, 1.0f / (2 * radius + 1));
+    this->separable(source, scratch, destination, width, height, weights);
+}
+
+
+void ImageFilters::sobel(unsigned int source, unsigned int destination, int width, int height)
+{
+    this->pass(this->variant("#define FILTER_SOBEL\n"), source, destination, width, height);
+}
+
+
+void ImageFilters::convolve(unsigned int source, unsigned int destination, int width, int height,
+    const std::vector<float>& kernel)
+{
+    int radius;
+    if (kernel.size() == 9)
+        radius = 1;
+    else if (kernel.size() == 25)
+        radius = 2;
+    else
+    {
+        std::cout << "ERROR::IMAGE_FILTERS::KERNEL_SIZE: " << kernel.size() << " weights, 9 or 25 expected"
+            << std::endl;
+        return;
+    }
+
+    ComputeShader& shader = this->variant("#define FILTER_CONVOLVE\n#define RADIUS " + std::to_string(radius) + "\n");
+    shader.use();
+    shader.set_float_array("weights", kernel.data(), kernel.size());
+    this->pass(shader, source, destination, width, height);
+}
+
+
+std::vector<float> ImageFilters::gaussian_weights(float sigma)
+{
+    sigma = std::max(sigma, 0.1f);
+    int radius = std::min((int)std::ceil(3.0f * sigma), (int)MAX_RADIUS);
+    std::vector<float> weights(2 * radius + 1);
+    float sum = 0.0f;
+    for (int i = -radius; i <= radius; i++)
+    {
+        weights[i + radius] = std::exp(-(float)(i * i) / (2.0f * sigma * sigma));
+        sum += weights[i + radius];
+    }
+    for (float& weight : weights)
+        weight /= sum;
+    return weights;
+}
+
+
+ComputeShader& ImageFilters::variant(const std::string& defines)
+{
+    auto found = this->shaders.find(defines);
+    if (found != this->shaders.end())
+        return *found->second;
+
+    ComputeShader* shader = new ComputeShader(this->shader_path.c_str(), image_format::glsl(this->format)
+        + WorkgroupTuner::glsl(this->local_size) + (this->tiled ? "#define TILED\n" : "") + defines);
+    this->shaders[defines] = shader;
+    return *shader;
+}
+
+
+void ImageFilters::separable(unsigned int source, unsigned int scratch, unsigned int destination, int width,
+    int height, const std::vector<float>& weights)
+{
+    std::string radius = "#define RADIUS " + std::to_string(weights.size() / 2) + "\n";
+    for (int direction = 0; direction < 2; direction++)
+    {
+        ComputeShader& shader = this->variant("#define FILTER_SEPARABLE\n#define DIRECTION "
+            + std::to_string(direction) + "\n" + radius);
+        shader.use();
+        shader.set_float_array("weights", weights.data(), weights.size());
+        if (direction == 0)
+            this->pass(shader, source, scratch, width, height);
+        else
+        {
+            // the columns read what the rows wrote
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            this->pass(shader, scratch, destination, width, height);
+        }
+    }
+}
+
+
+void ImageFilters::pass(ComputeShader& shader, unsigned int source, unsigned int destination, int width,
+    int height)
+{
+    shader.use();
+    glBindImageTexture(0, source, 0, GL_FALSE, 0, GL_READ_ONLY, this->format.internal_format);
+    glBindImageTexture(1, destination, 0, GL_FALSE, 0, GL_WRITE_ONLY, this->format.internal_format);
+    glDispatchCompute(WorkgroupTuner::groups(width, this->local_size.x),
+        WorkgroupTuner::groups(height, this->local_size.y), 1);
+}
+
+
+#endif
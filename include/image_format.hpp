@@ -0,0 +1,83 @@
+#ifndef IMAGE_FORMAT_H
+#define IMAGE_FORMAT_H
+
+#include "glad/glad.h"
+
+#include <iostream>
+#include <string>
+
+
+// Storage formats for images written by compute shaders. The texture is
+// allocated with internal_format and the shader declares the image with the
+// matching layout qualifier, inserted as
+//     #define IMAGE_FORMAT <layout>
+// Values the shader stores in [0,1] lose nothing visible in rgba8, a quarter of
+// the bandwidth of rgba32f.
+namespace image_format
+{
+
+struct ImageFormat
+{
+    const char* name;
+    GLenum internal_format;
+    // GLSL layout qualifier
+    const char* layout;
+    int bytes_per_texel;
+};
+
+const ImageFormat FORMATS[] = {
+    { "rgba8", GL_RGBA8, "rgba8", 4 },
+    { "rgba16f", GL_RGBA16F, "rgba16f", 8 },
+    { "r11g11b10f", GL_R11F_G11F_B10F, "r11f_g11f_b10f", 4 },
+    { "rgba32f", GL_RGBA32F, "rgba32f", 16 },
+};
+const int FORMAT_COUNT = sizeof(FORMATS) / sizeof(FORMATS[0]);
+
+
+/**
+ * @brief Looks a format up by name.
+ *
+ * @param name one of rgba8, rgba16f, r11g11b10f, rgba32f
+ * @return the format, or null with an error if the name is unknown
+ */
+const ImageFormat* find(const std::string& name)
+{
+    for (const ImageFormat& format : FORMATS)
+        if (name == format.name)
+            return &format;
+    std::cout << "ERROR::IMAGE_FORMAT::UNKNOWN_FORMAT: " << name << std::endl;
+    return nullptr;
+}
+
+
+/**
+ * @brief Defines for a compute shader writing to an image of this format.
+ *
+ * @param format
+ * @return "#define IMAGE_FORMAT <layout>\n"
+ */
+std::string glsl(const ImageFormat& format)
+{
+    return std::string("#define IMAGE_FORMAT ") + format.layout + "\n";
+}
+
+
+/**
+ * @brief Allocates the storage of a 2D texture for the format, bound to
+ * GL_TEXTURE_2D on the active unit.
+ *
+ * @param format
+ * @param width
+ * @param height
+ */
+void allocate(const ImageFormat& format, int width, int height)
+{
+    // storage only, the format and type of the missing data do not matter
+    glTexImage2D(GL_TEXTURE_2D, 0, format.internal_format, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+}
+
+
+}; // namespace image_format
+
+
+#endif
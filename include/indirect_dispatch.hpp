@@ -0,0 +1,78 @@
+#ifndef INDIRECT_DISPATCH_H
+#define INDIRECT_DISPATCH_H
+
+#include "glad/glad.h"
+#include "compute_shader.hpp"
+
+#include <vector>
+
+
+// Sizes dispatches from counts that only exist on the GPU. build() turns one
+// int of a counter buffer into a DispatchIndirectCommand in a slot of its own
+// argument buffer, and dispatch() runs a shader with it through
+// glDispatchComputeIndirect: no readback and no dispatch over the worst case.
+// The shader still bounds checks its invocations, the last group is partial.
+class IndirectDispatch
+{
+public:
+    // slots: commands kept at once, for several passes sized independently
+    IndirectDispatch(int slots = 1, const char* shader_path = "shaders/dispatch_args.comp");
+    ~IndirectDispatch();
+
+    // writes the command of slot for one invocation per item of
+    // counters[counter_index], in groups of group_size; uses SSBO binding points
+    // 0 and 1 and orders the command before the next indirect dispatch
+    void build(unsigned int counter_buffer, int counter_index, int group_size, int slot = 0);
+    // runs shader with the command of slot
+    void dispatch(ComputeShader& shader, int slot = 0);
+
+    unsigned int buffer;
+
+private:
+    ComputeShader args_shader;
+    int max_groups;
+};
+
+
+IndirectDispatch::IndirectDispatch(int slots, const char* shader_path) :
+    args_shader(shader_path)
+{
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &this->max_groups);
+
+    // valid empty commands until the first build
+    std::vector<GLuint> commands(3 * slots, 0);
+    glGenBuffers(1, &this->buffer);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, this->buffer);
+    glBufferData(GL_DISPATCH_INDIRECT_BUFFER, commands.size() * sizeof(GLuint), commands.data(), GL_DYNAMIC_COPY);
+}
+
+
+IndirectDispatch::~IndirectDispatch()
+{
+    glDeleteBuffers(1, &this->buffer);
+    glDeleteProgram(this->args_shader.ID);
+}
+
+
+void IndirectDispatch::build(unsigned int counter_buffer, int counter_index, int group_size, int slot)
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, counter_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, this->buffer);
+    this->args_shader.use();
+    this->args_shader.set_int("counterIndex", counter_index);
+    this->args_shader.set_int("groupSize", group_size);
+    this->args_shader.set_int("slot", slot);
+    this->args_shader.set_int("maxGroups", this->max_groups);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+}
+
+
+void IndirectDispatch::dispatch(ComputeShader& shader, int slot)
+{
+    shader.use();
+    shader.dispatch_indirect(this->buffer, slot * 3 * sizeof(GLuint));
+}
+
+
+#endif
@@ -0,0 +1,426 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace mesh
+{
+
+// Post-transform vertex cache statistics of an index buffer
+struct CacheStats
+{
+    // vertex shader invocations needed to draw the mesh
+    unsigned int transformed;
+    unsigned int triangle_count;
+    unsigned int vertex_count;
+    // average cache miss ratio: transformed vertices per triangle (0.5 is the ideal for large meshes)
+    float acmr;
+    // average transform to vertex ratio: transformed vertices per unique vertex (1.0 is the ideal)
+    float atvr;
+};
+
+
+/**
+ * @brief Merges vertices whose attributes are all within epsilon of those of a
+ * vertex already kept. vertices holds vertex_count interleaved vertices of
+ * stride floats and indices refers to them; pass an empty index vector for a
+ * non-indexed triangle soup (e.g. the 36 vertex cubes). Triangles collapsing to
+ * a line or point after welding are dropped.
+ *
+ * @param vertices
+ * @param indices
+ * @param stride
+ * @param epsilon
+ * @return std::pair<std::vector<float>, std::vector<unsigned int>> welded vertices and indices
+ */
+std::pair<std::vector<float>, std::vector<unsigned int>> weld_vertices(
+    const std::vector<float>& vertices, const std::vector<unsigned int>& indices,
+    int stride, float epsilon = 1e-6f)
+{
+    size_t vertex_count = vertices.size() / stride;
+    std::vector<float> welded;
+    std::vector<unsigned int> remap(vertex_count);
+    // kept vertices are bucketed by the cell of a grid of 2 epsilon their
+    // position (the first 3 attributes at most) falls in; a vertex within
+    // epsilon of a kept one is in the same cell or a neighbouring one, so the
+    // 3x3x3 cells around it are searched, not only its own
+    int dims = std::min(stride, 3);
+    std::unordered_map<uint64_t, std::vector<unsigned int>> buckets;
+    auto bucket_key = [](const int64_t* cell) {
+        uint64_t hash = 14695981039346656037ull;
+        for (int k = 0; k < 3; k++)
+            hash = (hash ^ (uint64_t)cell[k]) * 1099511628211ull;
+        return hash;
+    };
+
+    for (size_t v = 0; v < vertex_count; v++)
+    {
+        const float* attr = &vertices[v * stride];
+        int64_t cell[3] = { 0, 0, 0 };
+        for (int k = 0; k < dims; k++)
+            cell[k] = (int64_t)std::floor(attr[k] / (2.0f * epsilon));
+
+        unsigned int found = (unsigned int)-1;
+        for (int n = 0; n < 27 && found == (unsigned int)-1; n++)
+        {
+            int64_t probe[3];
+            bool used = true;
+            for (int k = 0, rest = n; k < 3; k++, rest /= 3)
+            {
+                int offset = rest % 3 - 1;
+                // axes past the position only have their own cell
+                used = used && (k < dims || offset == 0);
+                probe[k] = cell[k] + offset;
+            }
+            if (!used)
+                continue;
+            auto bucket = buckets.find(bucket_key(probe));
+            if (bucket == buckets.end())
+                continue;
+            for (unsigned int candidate : bucket->second)
+            {
+                const float* other = &welded[candidate * stride];
+                bool same = true;
+                for (int k = 0; k < stride && same; k++)
+                    same = std::abs(attr[k] - other[k]) <= epsilon;
+                if (same)
+                {
+                    found = candidate;
+                    break;
+                }
+            }
+        }
+
+        if (found == (unsigned int)-1)
+        {
+            found = welded.size() / stride;
+            welded.insert(welded.end(), attr, attr + stride);
+            buckets[bucket_key(cell)].push_back(found);
+        }
+        remap[v] = found;
+    }
+
+    std::vector<unsigned int> welded_indices;
+    size_t index_count = indices.empty() ? vertex_count : indices.size();
+    welded_indices.reserve(index_count);
+    for (size_t i = 0; i + 2 < index_count; i += 3)
+    {
+        unsigned int a = remap[indices.empty() ? i     : indices[i]];
+        unsigned int b = remap[indices.empty() ? i + 1 : indices[i + 1]];
+        unsigned int c = remap[indices.empty() ? i + 2 : indices[i + 2]];
+        if (a == b || b == c || a == c)
+            continue;
+        welded_indices.push_back(a);
+        welded_indices.push_back(b);
+        welded_indices.push_back(c);
+    }
+
+    return std::make_pair(welded, welded_indices);
+}
+
+
+/**
+ * @brief Simulates a FIFO post-transform cache of cache_size entries while
+ * drawing the triangle list and returns how many vertices get transformed.
+ *
+ * @param indices
+ * @param vertex_count
+ * @param cache_size
+ * @return CacheStats
+ */
+CacheStats analyze_vertex_cache(const std::vector<unsigned int>& indices,
+    size_t vertex_count, unsigned int cache_size = 16)
+{
+    // timestamp of the moment each vertex entered the cache
+    std::vector<unsigned int> entered(vertex_count, 0);
+    unsigned int time = cache_size + 1;
+    unsigned int transformed = 0;
+
+    for (unsigned int index : indices)
+    {
+        if (time - entered[index] > cache_size)
+        {
+            entered[index] = time++;
+            transformed++;
+        }
+    }
+
+    CacheStats stats;
+    stats.transformed = transformed;
+    stats.triangle_count = indices.size() / 3;
+    stats.vertex_count = vertex_count;
+    stats.acmr = stats.triangle_count ? (float)transformed / stats.triangle_count : 0.0f;
+    stats.atvr = vertex_count ? (float)transformed / vertex_count : 0.0f;
+    return stats;
+}
+
+
+/**
+ * @brief Reorders the triangles to improve post-transform vertex cache hits, using
+ * Tipsify (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex
+ * Locality and Reduced Overdraw", 2007). When clusters is not null it receives
+ * the index (in triangles) where each new cluster starts, to be consumed by
+ * optimize_overdraw.
+ *
+ * @param indices
+ * @param vertex_count
+ * @param cache_size
+ * @param clusters
+ * @return std::vector<unsigned int>
+ */
+std::vector<unsigned int> optimize_vertex_cache(const std::vector<unsigned int>& indices,
+    size_t vertex_count, unsigned int cache_size = 16, std::vector<unsigned int>* clusters = nullptr)
+{
+    size_t triangle_count = indices.size() / 3;
+
+    // vertex -> triangle adjacency
+    std::vector<unsigned int> live(vertex_count, 0);
+    for (unsigned int index : indices)
+        live[index]++;
+
+    std::vector<unsigned int> offsets(vertex_count + 1, 0);
+    for (size_t v = 0; v < vertex_count; v++)
+        offsets[v + 1] = offsets[v] + live[v];
+
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        adjacency[fill[indices[i]]++] = i / 3;
+
+    std::vector<unsigned int> cache_time(vertex_count, 0);
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<unsigned int> dead_end;
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+
+    unsigned int time = cache_size + 1;
+    unsigned int cursor = 0;
+    int fanning = triangle_count ? indices[0] : -1;
+
+    if (clusters)
+        clusters->clear();
+
+    while (fanning >= 0)
+    {
+        std::vector<unsigned int> candidates;
+
+        // emit every triangle around the fanning vertex
+        for (unsigned int a = offsets[fanning]; a < offsets[fanning + 1]; a++)
+        {
+            unsigned int t = adjacency[a];
+            if (emitted[t])
+                continue;
+
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int v = indices[3 * t + k];
+                output.push_back(v);
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cache_time[v] > cache_size)
+                    cache_time[v] = time++;
+            }
+            emitted[t] = true;
+        }
+
+        // next fanning vertex: the candidate that is still alive and most likely to
+        // still be in the cache once all its remaining triangles are emitted
+        int best = -1;
+        int best_priority = -1;
+        for (unsigned int v : candidates)
+        {
+            if (live[v] == 0)
+                continue;
+            int priority = 0;
+            if (time - cache_time[v] + 2 * live[v] <= cache_size)
+                priority = time - cache_time[v];
+            if (priority > best_priority)
+            {
+                best_priority = priority;
+                best = v;
+            }
+        }
+
+        if (best == -1)
+        {
+            // dead end: pop recently used vertices first, then scan linearly
+            while (!dead_end.empty() && best == -1)
+            {
+                unsigned int v = dead_end.back();
+                dead_end.pop_back();
+                if (live[v] > 0)
+                    best = v;
+            }
+            while (best == -1 && cursor < vertex_count)
+            {
+                if (live[cursor] > 0)
+                    best = cursor;
+                cursor++;
+            }
+            if (clusters && best != -1)
+                clusters->push_back(output.size() / 3);
+        }
+
+        fanning = best;
+    }
+
+    return output;
+}
+
+
+/**
+ * @brief Sorts the clusters produced by optimize_vertex_cache so that the ones
+ * facing away from the mesh centroid are drawn first, which lets early depth
+ * testing reject more of the hidden fragments of convex-ish meshes. Vertex
+ * cache efficiency inside each cluster is preserved.
+ *
+ * @param indices triangle list as returned by optimize_vertex_cache
+ * @param clusters cluster starts as returned by optimize_vertex_cache
+ * @param vertices
+ * @param stride positions are expected to be the first 3 floats of each vertex
+ * @return std::vector<unsigned int>
+ */
+std::vector<unsigned int> optimize_overdraw(const std::vector<unsigned int>& indices,
+    const std::vector<unsigned int>& clusters, const std::vector<float>& vertices, int stride)
+{
+    auto position = [&](unsigned int v) {
+        return glm::vec3(vertices[v * stride], vertices[v * stride + 1], vertices[v * stride + 2]);
+    };
+
+    size_t triangle_count = indices.size() / 3;
+    std::vector<unsigned int> starts;
+    starts.push_back(0);
+    for (unsigned int c : clusters)
+        if (c > starts.back() && c < triangle_count)
+            starts.push_back(c);
+
+    glm::vec3 mesh_center(0.0f);
+    for (unsigned int index : indices)
+        mesh_center += position(index);
+    mesh_center = mesh_center / std::max((float)indices.size(), 1.0f);
+
+    // sort key: how much a cluster faces outwards, outward facing clusters occlude the rest
+    std::vector<std::pair<float, size_t>> order;
+    for (size_t c = 0; c < starts.size(); c++)
+    {
+        size_t end = c + 1 < starts.size() ? starts[c + 1] : triangle_count;
+        glm::vec3 center(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = starts[c]; t < end; t++)
+        {
+            glm::vec3 p0 = position(indices[3 * t]);
+            glm::vec3 p1 = position(indices[3 * t + 1]);
+            glm::vec3 p2 = position(indices[3 * t + 2]);
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float a = glm::length(n);
+            center += (p0 + p1 + p2) * (a / 3.0f);
+            normal += n;
+            area += a;
+        }
+        if (area > 0.0f)
+            center = center / area;
+        float facing = glm::dot(center - mesh_center, normal);
+        order.push_back(std::make_pair(-facing, c));
+    }
+    std::stable_sort(order.begin(), order.end(),
+        [](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) { return a.first < b.first; });
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    for (const auto& entry : order)
+    {
+        size_t c = entry.second;
+        size_t end = c + 1 < starts.size() ? starts[c + 1] : triangle_count;
+        output.insert(output.end(), indices.begin() + 3 * starts[c], indices.begin() + 3 * end);
+    }
+    return output;
+}
+
+
+/**
+ * @brief Reorders the vertices in the order the index buffer first references
+ * them, so that vertex fetch walks memory linearly. Both vectors are updated in
+ * place; vertices never referenced are dropped.
+ *
+ * @param vertices
+ * @param indices
+ * @param stride
+ */
+void optimize_vertex_fetch(std::vector<float>& vertices, std::vector<unsigned int>& indices, int stride)
+{
+    size_t vertex_count = vertices.size() / stride;
+    std::vector<unsigned int> remap(vertex_count, (unsigned int)-1);
+    std::vector<float> reordered;
+    reordered.reserve(vertices.size());
+
+    unsigned int next = 0;
+    for (unsigned int& index : indices)
+    {
+        if (remap[index] == (unsigned int)-1)
+        {
+            remap[index] = next++;
+            reordered.insert(reordered.end(),
+                vertices.begin() + index * stride, vertices.begin() + (index + 1) * stride);
+        }
+        index = remap[index];
+    }
+
+    vertices.swap(reordered);
+}
+
+
+/**
+ * @brief Runs the whole optimization stage on an indexed triangle list:
+ * welding, vertex cache ordering, overdraw cluster sorting and vertex fetch
+ * ordering.
+ *
+ * @param vertices
+ * @param indices
+ * @param stride
+ * @param cache_size
+ */
+void optimize(std::vector<float>& vertices, std::vector<unsigned int>& indices, int stride,
+    unsigned int cache_size = 16)
+{
+    auto welded = weld_vertices(vertices, indices, stride);
+    vertices.swap(welded.first);
+    indices.swap(welded.second);
+
+    std::vector<unsigned int> clusters;
+    indices = optimize_vertex_cache(indices, vertices.size() / stride, cache_size, &clusters);
+    indices = optimize_overdraw(indices, clusters, vertices, stride);
+    optimize_vertex_fetch(vertices, indices, stride);
+}
+
+
+/**
+ * @brief Prints the vertex cache statistics of a mesh before and after optimization.
+ *
+ * @param name
+ * @param before
+ * @param after
+ */
+void report(const std::string& name, const CacheStats& before, const CacheStats& after)
+{
+    std::cout << name << ": " << before.triangle_count << " triangles" << std::endl;
+    std::cout << "    ACMR " << before.acmr << " -> " << after.acmr
+        << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+    std::cout << "    vertex shader invocations " << before.transformed << " -> " << after.transformed
+        << " (" << (int)before.transformed - (int)after.transformed << " saved)" << std::endl;
+}
+
+
+}; // namespace mesh
+
+
+#endif
@@ -0,0 +1,268 @@
+#ifndef PARAMETRIC_H
+#define PARAMETRIC_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define PARAMETRIC_SSE
+#endif
+
+
+namespace parametric
+{
+
+// Every surface of revolution built here is a grid of rings: ring i is the
+// circle of radius xy at height z, and its vertices are
+//     (xy * cos(u_j), xy * sin(u_j), z, s_j, t)
+// for the sector angles u_j shared by all rings. Writing the sector table
+// interleaved as (cos u_j, sin u_j, 0, s_j, 0) turns every ring into
+//     vertex = table * (xy, xy, 0, 1, 0) + (0, 0, z, 0, t)
+// which is a plain multiply-add over contiguous floats: the sin/cos are
+// computed once per sector instead of once per vertex and the ring loop
+// vectorizes without any shuffle. The output layout matches
+// sphere::build_sphere_vertex (x, y, z, s, t).
+struct Ring
+{
+    float xy;
+    float z;
+    float t;
+};
+
+typedef std::pair<std::vector<float>, std::vector<unsigned int>> Mesh;
+
+
+/**
+ * @brief Interleaved sector table of sector_count + 1 entries (cos, sin, 0, s, 0).
+ *
+ * @param sector_count
+ * @return std::vector<float>
+ */
+std::vector<float> build_sector_table(int sector_count)
+{
+    std::vector<float> table((sector_count + 1) * 5);
+    float sector_step = glm::two_pi<double>() / sector_count;
+    for (int j = 0; j <= sector_count; j++)
+    {
+        float sector_angle = j * sector_step;
+        table[j * 5 + 0] = glm::cos(sector_angle);
+        table[j * 5 + 1] = glm::sin(sector_angle);
+        table[j * 5 + 2] = 0.0f;
+        table[j * 5 + 3] = (float) j / sector_count;
+        table[j * 5 + 4] = 0.0f;
+    }
+    return table;
+}
+
+
+/**
+ * @brief Writes one ring of vertices: out[k] = table[k] * scale[k % 5] + offset[k % 5].
+ *
+ * @param table sector table from build_sector_table
+ * @param count number of floats in the ring
+ * @param ring
+ * @param out
+ */
+void emit_ring(const float* table, size_t count, const Ring& ring, float* out)
+{
+    const float scale[5] = { ring.xy, ring.xy, 0.0f, 1.0f, 0.0f };
+    const float offset[5] = { 0.0f, 0.0f, ring.z, 0.0f, ring.t };
+    size_t k = 0;
+
+#ifdef PARAMETRIC_SSE
+    // 4 vertices are 20 floats, 5 registers whose scale/offset pattern never changes
+    __m128 s[5], o[5];
+    for (int r = 0; r < 5; r++)
+    {
+        s[r] = _mm_setr_ps(scale[(4 * r) % 5], scale[(4 * r + 1) % 5],
+            scale[(4 * r + 2) % 5], scale[(4 * r + 3) % 5]);
+        o[r] = _mm_setr_ps(offset[(4 * r) % 5], offset[(4 * r + 1) % 5],
+            offset[(4 * r + 2) % 5], offset[(4 * r + 3) % 5]);
+    }
+    for (; k + 20 <= count; k += 20)
+    {
+        for (int r = 0; r < 5; r++)
+        {
+            __m128 v = _mm_loadu_ps(table + k + 4 * r);
+            _mm_storeu_ps(out + k + 4 * r, _mm_add_ps(_mm_mul_ps(v, s[r]), o[r]));
+        }
+    }
+#endif
+
+    for (; k < count; k++)
+        out[k] = table[k] * scale[k % 5] + offset[k % 5];
+}
+
+
+/**
+ * @brief Builds the mesh of a grid of rings, splitting the rings over
+ * thread_count threads (0 uses every hardware thread).
+ *
+ * @param rings
+ * @param sector_count
+ * @param thread_count
+ * @return Mesh
+ */
+Mesh build_rings(const std::vector<Ring>& rings, int sector_count, unsigned int thread_count = 1)
+{
+    Mesh mesh;
+    std::vector<float>& vertices = mesh.first;
+    std::vector<unsigned int>& indices = mesh.second;
+
+    size_t ring_vertices = sector_count + 1;
+    size_t ring_floats = ring_vertices * 5;
+    size_t band_count = rings.size() > 0 ? rings.size() - 1 : 0;
+    vertices.resize(rings.size() * ring_floats);
+    indices.resize(band_count * sector_count * 6);
+
+    std::vector<float> table = build_sector_table(sector_count);
+
+    auto build_range = [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+        {
+            emit_ring(table.data(), ring_floats, rings[i], &vertices[i * ring_floats]);
+
+            if (i >= band_count)
+                continue;
+            unsigned int k1 = i * ring_vertices;
+            unsigned int k2 = k1 + ring_vertices;
+            unsigned int* out = &indices[i * sector_count * 6];
+            for (int j = 0; j < sector_count; j++, k1++, k2++)
+            {
+                out[0] = k1;
+                out[1] = k2;
+                out[2] = k1 + 1;
+                out[3] = k1 + 1;
+                out[4] = k2;
+                out[5] = k2 + 1;
+                out += 6;
+            }
+        }
+    };
+
+    if (thread_count == 0)
+        thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+    thread_count = std::min<size_t>(thread_count, std::max<size_t>(rings.size(), 1));
+
+    if (thread_count <= 1)
+    {
+        build_range(0, rings.size());
+        return mesh;
+    }
+
+    std::vector<std::thread> workers;
+    size_t chunk = (rings.size() + thread_count - 1) / thread_count;
+    for (size_t first = 0; first < rings.size(); first += chunk)
+        workers.emplace_back(build_range, first, std::min(first + chunk, rings.size()));
+    for (std::thread& worker : workers)
+        worker.join();
+
+    return mesh;
+}
+
+
+/**
+ * @brief Same sphere as sphere::build_sphere_vertex, built ring by ring.
+ *
+ * @param r
+ * @param sector_count
+ * @param stack_count
+ * @param thread_count
+ * @return Mesh
+ */
+Mesh build_sphere(float r, int sector_count, int stack_count, unsigned int thread_count = 1)
+{
+    std::vector<Ring> rings(stack_count + 1);
+    float stack_step = glm::pi<double>() / stack_count;
+    for (int i = 0; i <= stack_count; i++)
+    {
+        float stack_angle = glm::half_pi<float>() - i * stack_step;
+        rings[i].xy = r * glm::cos(stack_angle);
+        rings[i].z = r * glm::sin(stack_angle);
+        rings[i].t = (float) i / stack_count;
+    }
+    return build_rings(rings, sector_count, thread_count);
+}
+
+
+/**
+ * @brief Torus around the z axis: a tube of radius minor_r swept along a circle
+ * of radius major_r.
+ *
+ * @param major_r
+ * @param minor_r
+ * @param sector_count subdivisions along the sweep
+ * @param side_count subdivisions around the tube
+ * @param thread_count
+ * @return Mesh
+ */
+Mesh build_torus(float major_r, float minor_r, int sector_count, int side_count,
+    unsigned int thread_count = 1)
+{
+    std::vector<Ring> rings(side_count + 1);
+    float side_step = glm::two_pi<double>() / side_count;
+    for (int i = 0; i <= side_count; i++)
+    {
+        float side_angle = i * side_step;
+        rings[i].xy = major_r + minor_r * glm::cos(side_angle);
+        rings[i].z = minor_r * glm::sin(side_angle);
+        rings[i].t = (float) i / side_count;
+    }
+    return build_rings(rings, sector_count, thread_count);
+}
+
+
+/**
+ * @brief Capsule along the z axis: two hemispheres of radius r joined by a
+ * cylinder of length 2 * half_height. Each hemisphere gets stack_count / 2 stacks.
+ *
+ * @param r
+ * @param half_height
+ * @param sector_count
+ * @param stack_count
+ * @param thread_count
+ * @return Mesh
+ */
+Mesh build_capsule(float r, float half_height, int sector_count, int stack_count,
+    unsigned int thread_count = 1)
+{
+    int hemisphere_stacks = std::max(stack_count / 2, 1);
+    float stack_step = glm::half_pi<double>() / hemisphere_stacks;
+
+    std::vector<Ring> rings;
+    rings.reserve(2 * hemisphere_stacks + 2);
+    float arc = 0.0f;
+    for (int h = 0; h < 2; h++)
+    {
+        float z_offset = h == 0 ? half_height : -half_height;
+        for (int i = 0; i <= hemisphere_stacks; i++)
+        {
+            float stack_angle = h == 0 ? glm::half_pi<float>() - i * stack_step : -i * stack_step;
+            Ring ring;
+            ring.xy = r * glm::cos(stack_angle);
+            ring.z = r * glm::sin(stack_angle) + z_offset;
+            if (!rings.empty())
+                arc += std::hypot(rings.back().z - ring.z, rings.back().xy - ring.xy);
+            ring.t = arc;
+            rings.push_back(ring);
+        }
+    }
+    // t grows with the distance walked along the profile
+    for (Ring& ring : rings)
+        ring.t = arc > 0.0f ? ring.t / arc : 0.0f;
+
+    return build_rings(rings, sector_count, thread_count);
+}
+
+
+}; // namespace parametric
+
+
+#endif
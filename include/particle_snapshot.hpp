@@ -0,0 +1,146 @@
+#ifndef PARTICLE_SNAPSHOT_H
+#define PARTICLE_SNAPSHOT_H
+
+#include "glad/glad.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+// Binary snapshots of particle buffers, to restart a simulation from the exact
+// same state. Layout, native (little endian) byte order:
+//     Header
+//     array_count arrays of count * components floats
+// The arrays are streamed from the GL buffers a chunk at a time, so saving a
+// few million particles never holds a full copy in memory.
+namespace snapshot
+{
+
+const char MAGIC[4] = { 'P', 'S', 'N', 'P' };
+const uint32_t VERSION = 1;
+
+struct Header
+{
+    char magic[4];
+    uint32_t version;
+    // simulation step the particles are at, the step that runs next
+    uint64_t step;
+    double step_seconds;
+    uint32_t count;
+    // floats per particle in every array
+    uint32_t components;
+    uint32_t array_count;
+    uint32_t reserved;
+};
+static_assert(sizeof(Header) == 40, "the snapshot header is written as is");
+
+
+Header make_header(uint64_t step, double step_seconds, uint32_t count, uint32_t components, uint32_t array_count)
+{
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.step = step;
+    header.step_seconds = step_seconds;
+    header.count = count;
+    header.components = components;
+    header.array_count = array_count;
+    header.reserved = 0;
+    return header;
+}
+
+
+/**
+ * @brief Writes the header and the first count * components floats of every
+ * buffer, read through a mapping of at most chunk_bytes at a time.
+ *
+ * @param path
+ * @param header
+ * @param buffers one GL buffer per array
+ * @param chunk_bytes
+ * @return true on success
+ */
+bool save(const std::string& path, const Header& header, const std::vector<unsigned int>& buffers,
+    size_t chunk_bytes = 4 << 20)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cout << "ERROR::SNAPSHOT::CANNOT_OPEN: " << path << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // shader writes have to land before the mapping reads them
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    size_t bytes = (size_t)header.count * header.components * sizeof(float);
+    for (unsigned int buffer : buffers)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        for (size_t offset = 0; offset < bytes; offset += chunk_bytes)
+        {
+            size_t size = std::min(chunk_bytes, bytes - offset);
+            void* data = glMapBufferRange(GL_COPY_READ_BUFFER, offset, size, GL_MAP_READ_BIT);
+            if (data == NULL)
+            {
+                std::cout << "ERROR::SNAPSHOT::CANNOT_MAP_BUFFER: " << buffer << std::endl;
+                return false;
+            }
+            file.write(static_cast<const char*>(data), size);
+            glUnmapBuffer(GL_COPY_READ_BUFFER);
+        }
+    }
+
+    if (!file)
+    {
+        std::cout << "ERROR::SNAPSHOT::WRITE_FAILED: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Reads a snapshot written by save() back into memory.
+ *
+ * @param path
+ * @param header
+ * @param arrays one vector of count * components floats per array
+ * @return true on success
+ */
+bool load(const std::string& path, Header& header, std::vector<std::vector<float>>& arrays)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file || !file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    {
+        std::cout << "ERROR::SNAPSHOT::CANNOT_READ: " << path << std::endl;
+        return false;
+    }
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION)
+    {
+        std::cout << "ERROR::SNAPSHOT::UNSUPPORTED_FORMAT: " << path << std::endl;
+        return false;
+    }
+
+    arrays.assign(header.array_count, std::vector<float>((size_t)header.count * header.components));
+    for (std::vector<float>& array : arrays)
+    {
+        if (!file.read(reinterpret_cast<char*>(array.data()), array.size() * sizeof(float)))
+        {
+            std::cout << "ERROR::SNAPSHOT::TRUNCATED: " << path << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+
+}; // namespace snapshot
+
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef PARTICLE_STORAGE_H
+#define PARTICLE_STORAGE_H
+
+#include "glad/glad.h"
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+
+// Structure-of-arrays storage for GPU particles: every field lives in its own
+// SSBO so a pass only pulls the fields it touches, and packed fields do not pay
+// for std430 padding. The shaders never declare the buffers themselves; they
+// get the declarations and accessors from glsl(), which is inserted after the
+// #version line of every shader that reads the particles, so the compute
+// passes and the vertex shader always agree on the layout.
+//
+// Fields (accessors load_X(i) / store_X(i, value), all vec4):
+//     position  xyz position, w age in seconds     always 32 bit floats
+//     velocity  xyz velocity, w lifetime in seconds
+//     color     rgba
+// plus load_particle(i) / store_particle(i, p) for the whole Particle struct.
+namespace particles
+{
+
+enum Precision {
+    FULL, // vec4 per field                            = 48 bytes per particle
+    HALF  // velocity and color as 4 x half (uvec2)    = 32 bytes per particle
+};
+
+// binding points of the field buffers
+struct Bindings
+{
+    unsigned int position;
+    unsigned int velocity;
+    unsigned int color;
+};
+
+
+class ParticleStorage
+{
+public:
+    ParticleStorage(unsigned int capacity, Precision precision, Bindings bindings = { 0, 6, 7 });
+    ~ParticleStorage();
+
+    // binds every field buffer to its binding point
+    void bind() const;
+    // GLSL declarations of the field buffers and their accessors
+    std::string glsl() const;
+    size_t bytes_per_particle() const;
+
+    unsigned int capacity;
+    Precision precision;
+    Bindings bindings;
+
+private:
+    size_t field_size(int field) const;
+
+    // position, velocity, color
+    unsigned int buffers[3];
+};
+
+
+ParticleStorage::ParticleStorage(unsigned int capacity, Precision precision, Bindings bindings) :
+    capacity(capacity), precision(precision), bindings(bindings)
+{
+    glGenBuffers(3, this->buffers);
+    for (int field = 0; field < 3; field++)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->buffers[field]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t)capacity * this->field_size(field), NULL, GL_DYNAMIC_COPY);
+    }
+}
+
+
+ParticleStorage::~ParticleStorage()
+{
+    glDeleteBuffers(3, this->buffers);
+}
+
+
+size_t ParticleStorage::field_size(int field) const
+{
+    // positions are never packed: they accumulate small steps every frame
+    if (field == 0 || this->precision == FULL)
+        return 4 * sizeof(float);
+    return 4 * sizeof(uint16_t);
+}
+
+
+size_t ParticleStorage::bytes_per_particle() const
+{
+    return this->field_size(0) + this->field_size(1) + this->field_size(2);
+}
+
+
+void ParticleStorage::bind() const
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, this->bindings.position, this->buffers[0]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, this->bindings.velocity, this->buffers[1]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, this->bindings.color, this->buffers[2]);
+}
+
+
+std::string ParticleStorage::glsl() const
+{
+    const char* names[3] = { "position", "velocity", "color" };
+    const unsigned int binding_points[3] = { this->bindings.position, this->bindings.velocity, this->bindings.color };
+
+    std::ostringstream glsl;
+    glsl << "// particle storage generated by particles::ParticleStorage\n"
+         << "struct Particle\n{\n"
+         << "    vec4 position_age;\n"
+         << "    vec4 velocity_life;\n"
+         << "    vec4 color;\n"
+         << "};\n";
+
+    for (int field = 0; field < 3; field++)
+    {
+        std::string name = names[field];
+        bool packed = this->field_size(field) != 4 * sizeof(float);
+
+        glsl << "layout(std430, binding = " << binding_points[field] << ") buffer " << name << "Buffer\n{\n"
+             << "    " << (packed ? "uvec2" : "vec4") << " " << name << "Data[];\n};\n";
+        if (packed)
+        {
+            glsl << "vec4 load_" << name << "(uint i)\n{\n"
+                 << "    uvec2 h = " << name << "Data[i];\n"
+                 << "    return vec4(unpackHalf2x16(h.x), unpackHalf2x16(h.y));\n}\n"
+                 << "void store_" << name << "(uint i, vec4 value)\n{\n"
+                 << "    " << name << "Data[i] = uvec2(packHalf2x16(value.xy), packHalf2x16(value.zw));\n}\n";
+        }
+        else
+        {
+            glsl << "vec4 load_" << name << "(uint i)\n{\n"
+                 << "    return " << name << "Data[i];\n}\n"
+                 << "void store_" << name << "(uint i, vec4 value)\n{\n"
+                 << "    " << name << "Data[i] = value;\n}\n";
+        }
+    }
+
+    glsl << "Particle load_particle(uint i)\n{\n"
+         << "    return Particle(load_position(i), load_velocity(i), load_color(i));\n}\n"
+         << "void store_particle(uint i, Particle p)\n{\n"
+         << "    store_position(i, p.position_age);\n"
+         << "    store_velocity(i, p.velocity_life);\n"
+         << "    store_color(i, p.color);\n}\n";
+    return glsl.str();
+}
+
+
+}; // namespace particles
+
+
+#endif
@@ -0,0 +1,289 @@
+#ifndef PASS_GRAPH_H
+#define PASS_GRAPH_H
+
+#include "glad/glad.h"
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+// Places glMemoryBarrier calls from what compute and draw passes declare they
+// read and write. Shader writes to buffers, images and atomic counters are
+// incoherent: a later access sees them only after a barrier with the bit of
+// that access, e.g. GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT before drawing from a
+// buffer a compute shader wrote. The graph remembers which resources hold such
+// writes and which bits they were made visible to, and before every pass issues
+// one barrier with exactly the bits its accesses still need. Copies, clears and
+// draws to a framebuffer are ordered by GL itself and never need one.
+//
+// Passes are declared once and run in any order, every frame or only some; the
+// state carries over between frames, so a buffer written by the last pass of a
+// frame is still protected in the first pass of the next one.
+namespace pass_graph
+{
+
+// how a pass touches a resource; each maps to the barrier bit that makes
+// earlier shader writes visible to it
+enum Access
+{
+    SHADER_STORAGE,
+    SHADER_IMAGE,
+    ATOMIC_COUNTER,
+    TEXTURE_FETCH,
+    VERTEX_ATTRIB,
+    ELEMENT_ARRAY,
+    UNIFORM,
+    COMMAND,
+    BUFFER_UPDATE,
+    TEXTURE_UPDATE,
+    PIXEL_BUFFER,
+    FRAMEBUFFER
+};
+
+struct Use
+{
+    int resource;
+    Access access;
+    bool write;
+};
+
+// resource handle with a read or a write of it
+inline Use read(int resource, Access access) { return { resource, access, false }; }
+inline Use write(int resource, Access access) { return { resource, access, true }; }
+inline Use read_write(int resource, Access access) { return { resource, access, true }; }
+
+
+/**
+ * @brief Barrier bit making shader writes visible to an access.
+ *
+ * @param access
+ * @return GL_*_BARRIER_BIT
+ */
+GLbitfield barrier_bit(Access access)
+{
+    switch (access)
+    {
+    case SHADER_STORAGE: return GL_SHADER_STORAGE_BARRIER_BIT;
+    case SHADER_IMAGE: return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+    case ATOMIC_COUNTER: return GL_ATOMIC_COUNTER_BARRIER_BIT;
+    case TEXTURE_FETCH: return GL_TEXTURE_FETCH_BARRIER_BIT;
+    case VERTEX_ATTRIB: return GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT;
+    case ELEMENT_ARRAY: return GL_ELEMENT_ARRAY_BARRIER_BIT;
+    case UNIFORM: return GL_UNIFORM_BARRIER_BIT;
+    case COMMAND: return GL_COMMAND_BARRIER_BIT;
+    case BUFFER_UPDATE: return GL_BUFFER_UPDATE_BARRIER_BIT;
+    case TEXTURE_UPDATE: return GL_TEXTURE_UPDATE_BARRIER_BIT;
+    case PIXEL_BUFFER: return GL_PIXEL_BUFFER_BARRIER_BIT;
+    case FRAMEBUFFER: return GL_FRAMEBUFFER_BARRIER_BIT;
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Names of the bits of a barrier, for reports.
+ *
+ * @param bits
+ * @return e.g. "SHADER_STORAGE | VERTEX_ATTRIB_ARRAY", "none" for 0
+ */
+std::string bit_names(GLbitfield bits)
+{
+    struct Name
+    {
+        GLbitfield bit;
+        const char* name;
+    };
+    const Name names[] = {
+        { GL_SHADER_STORAGE_BARRIER_BIT, "SHADER_STORAGE" },
+        { GL_SHADER_IMAGE_ACCESS_BARRIER_BIT, "SHADER_IMAGE_ACCESS" },
+        { GL_ATOMIC_COUNTER_BARRIER_BIT, "ATOMIC_COUNTER" },
+        { GL_TEXTURE_FETCH_BARRIER_BIT, "TEXTURE_FETCH" },
+        { GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT, "VERTEX_ATTRIB_ARRAY" },
+        { GL_ELEMENT_ARRAY_BARRIER_BIT, "ELEMENT_ARRAY" },
+        { GL_UNIFORM_BARRIER_BIT, "UNIFORM" },
+        { GL_COMMAND_BARRIER_BIT, "COMMAND" },
+        { GL_BUFFER_UPDATE_BARRIER_BIT, "BUFFER_UPDATE" },
+        { GL_TEXTURE_UPDATE_BARRIER_BIT, "TEXTURE_UPDATE" },
+        { GL_PIXEL_BUFFER_BARRIER_BIT, "PIXEL_BUFFER" },
+        { GL_FRAMEBUFFER_BARRIER_BIT, "FRAMEBUFFER" },
+    };
+    std::string result;
+    for (const Name& name : names)
+        if (bits & name.bit)
+            result += (result.empty() ? "" : " | ") + std::string(name.name);
+    return result.empty() ? "none" : result;
+}
+
+
+class PassGraph
+{
+public:
+    // registers a buffer, texture or image under a name for the reports
+    int resource(const std::string& name);
+    // declares a pass; run issues its GL commands
+    int add_pass(const std::string& name, const std::vector<Use>& uses, const std::function<void()>& run);
+    // runs one pass, after the barrier its reads need
+    void run(int pass);
+    // runs every pass in the order they were added
+    void execute();
+    // hand placed barrier, for code that is not a pass: issues only the bits
+    // some unflushed write still needs and counts the others as redundant
+    void barrier(const std::string& site, GLbitfield bits);
+    // barriers issued per pass and redundant bits per hand placed barrier
+    void report() const;
+
+private:
+    struct Resource
+    {
+        std::string name;
+        // written by a shader since the last barrier of every bit
+        bool dirty;
+        // bits issued since that write
+        GLbitfield visible;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        std::vector<Use> uses;
+        std::function<void()> run;
+        unsigned long runs;
+        unsigned long barriers;
+        GLbitfield bits;
+    };
+
+    struct Site
+    {
+        std::string name;
+        unsigned long calls;
+        unsigned long redundant;
+        GLbitfield redundant_bits;
+    };
+
+    // bits still missing for any resource to be seen by an access of bits
+    GLbitfield missing(GLbitfield bits) const;
+    void issue(GLbitfield bits);
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<Site> sites;
+};
+
+
+int PassGraph::resource(const std::string& name)
+{
+    this->resources.push_back({ name, false, 0 });
+    return this->resources.size() - 1;
+}
+
+
+int PassGraph::add_pass(const std::string& name, const std::vector<Use>& uses, const std::function<void()>& run)
+{
+    this->passes.push_back({ name, uses, run, 0, 0, 0 });
+    return this->passes.size() - 1;
+}
+
+
+void PassGraph::run(int index)
+{
+    Pass& pass = this->passes[index];
+
+    GLbitfield bits = 0;
+    for (const Use& use : pass.uses)
+    {
+        const Resource& resource = this->resources[use.resource];
+        GLbitfield bit = barrier_bit(use.access);
+        if (resource.dirty && !(resource.visible & bit))
+            bits |= bit;
+    }
+    if (bits != 0)
+    {
+        this->issue(bits);
+        pass.barriers++;
+        pass.bits |= bits;
+    }
+
+    pass.run();
+    pass.runs++;
+
+    // incoherent writes, to be made visible to whatever reads them next
+    for (const Use& use : pass.uses)
+    {
+        if (!use.write || (use.access != SHADER_STORAGE && use.access != SHADER_IMAGE && use.access != ATOMIC_COUNTER))
+            continue;
+        Resource& resource = this->resources[use.resource];
+        resource.dirty = true;
+        resource.visible = 0;
+    }
+}
+
+
+void PassGraph::execute()
+{
+    for (size_t i = 0; i < this->passes.size(); i++)
+        this->run(i);
+}
+
+
+void PassGraph::barrier(const std::string& site, GLbitfield bits)
+{
+    Site* entry = nullptr;
+    for (Site& s : this->sites)
+        if (s.name == site)
+            entry = &s;
+    if (entry == nullptr)
+    {
+        this->sites.push_back({ site, 0, 0, 0 });
+        entry = &this->sites.back();
+    }
+
+    GLbitfield needed = this->missing(bits);
+    entry->calls++;
+    if (needed != bits)
+    {
+        entry->redundant++;
+        entry->redundant_bits |= bits & ~needed;
+    }
+    if (needed != 0)
+        this->issue(needed);
+}
+
+
+GLbitfield PassGraph::missing(GLbitfield bits) const
+{
+    GLbitfield result = 0;
+    for (const Resource& resource : this->resources)
+        if (resource.dirty)
+            result |= bits & ~resource.visible;
+    return result;
+}
+
+
+void PassGraph::issue(GLbitfield bits)
+{
+    glMemoryBarrier(bits);
+    // a barrier covers every write issued before it, not only those of one resource
+    for (Resource& resource : this->resources)
+        if (resource.dirty)
+            resource.visible |= bits;
+}
+
+
+void PassGraph::report() const
+{
+    std::cout << "pass graph:" << std::endl;
+    for (const Pass& pass : this->passes)
+        std::cout << "  " << pass.name << ": " << pass.runs << " runs, " << pass.barriers << " barriers ("
+            << bit_names(pass.bits) << ")" << std::endl;
+    for (const Site& site : this->sites)
+        std::cout << "  barrier at " << site.name << ": " << site.calls << " calls, " << site.redundant
+            << " redundant (" << bit_names(site.redundant_bits) << ")" << std::endl;
+}
+
+
+}; // namespace pass_graph
+
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef PING_PONG_H
+#define PING_PONG_H
+
+#include "glad/glad.h"
+#include "image_format.hpp"
+
+#include <functional>
+#include <utility>
+
+
+// Two copies of the state of an iterative simulation (diffusion, fluids,
+// cellular automata). Every step reads one copy and writes the other, so no
+// invocation reads a cell a neighbour already overwrote in the same step, then
+// swap() flips the roles. Updating a single GL_READ_WRITE image in place races
+// as soon as a cell reads its neighbours.
+class PingPong
+{
+public:
+    // the copy the next step reads, i.e. the latest state
+    unsigned int read() const { return this->names[this->current]; }
+    // the copy the next step writes
+    unsigned int write() const { return this->names[1 - this->current]; }
+    void swap() { this->current = 1 - this->current; }
+
+protected:
+    PingPong() : current(0) {}
+
+    unsigned int names[2];
+    int current;
+};
+
+
+// Pair of 2D textures used as images
+class PingPongTexture : public PingPong
+{
+public:
+    PingPongTexture(int width, int height, const image_format::ImageFormat& format);
+    ~PingPongTexture();
+
+    // binds the read copy as a read only image and the write copy as a write only one
+    void bind(unsigned int read_unit = 0, unsigned int write_unit = 1) const;
+    // runs steps steps of step(i), each after a bind and an image access barrier
+    // for the writes of the step before it, swapping after every step; leaves
+    // the result in read(), behind no barrier
+    void iterate(int steps, const std::function<void(int)>& step, unsigned int read_unit = 0,
+        unsigned int write_unit = 1);
+
+    int width;
+    int height;
+    const image_format::ImageFormat& format;
+};
+
+
+// Pair of SSBOs of the same size
+class PingPongBuffer : public PingPong
+{
+public:
+    // data, if any, fills both copies
+    PingPongBuffer(size_t bytes, const void* data = NULL);
+    ~PingPongBuffer();
+
+    // binds the read and write copies to SSBO binding points
+    void bind(unsigned int read_binding = 0, unsigned int write_binding = 1) const;
+    // same as PingPongTexture::iterate with a shader storage barrier
+    void iterate(int steps, const std::function<void(int)>& step, unsigned int read_binding = 0,
+        unsigned int write_binding = 1);
+
+    size_t bytes;
+};
+
+
+PingPongTexture::PingPongTexture(int width, int height, const image_format::ImageFormat& format) :
+    width(width), height(height), format(format)
+{
+    glGenTextures(2, this->names);
+    for (unsigned int texture : this->names)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        image_format::allocate(format, width, height);
+    }
+}
+
+
+PingPongTexture::~PingPongTexture()
+{
+    glDeleteTextures(2, this->names);
+}
+
+
+void PingPongTexture::bind(unsigned int read_unit, unsigned int write_unit) const
+{
+    glBindImageTexture(read_unit, this->read(), 0, GL_FALSE, 0, GL_READ_ONLY, this->format.internal_format);
+    glBindImageTexture(write_unit, this->write(), 0, GL_FALSE, 0, GL_WRITE_ONLY, this->format.internal_format);
+}
+
+
+void PingPongTexture::iterate(int steps, const std::function<void(int)>& step, unsigned int read_unit,
+    unsigned int write_unit)
+{
+    for (int i = 0; i < steps; i++)
+    {
+        // the read copy was written by the previous step, or the previous iterate()
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        this->bind(read_unit, write_unit);
+        step(i);
+        this->swap();
+    }
+}
+
+
+PingPongBuffer::PingPongBuffer(size_t bytes, const void* data) :
+    bytes(bytes)
+{
+    glGenBuffers(2, this->names);
+    for (unsigned int buffer : this->names)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, data, GL_DYNAMIC_COPY);
+    }
+}
+
+
+PingPongBuffer::~PingPongBuffer()
+{
+    glDeleteBuffers(2, this->names);
+}
+
+
+void PingPongBuffer::bind(unsigned int read_binding, unsigned int write_binding) const
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, read_binding, this->read());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, write_binding, this->write());
+}
+
+
+void PingPongBuffer::iterate(int steps, const std::function<void(int)>& step, unsigned int read_binding,
+    unsigned int write_binding)
+{
+    for (int i = 0; i < steps; i++)
+    {
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        this->bind(read_binding, write_binding);
+        step(i);
+        this->swap();
+    }
+}
+
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef PREFIX_SCAN_H
+#define PREFIX_SCAN_H
+
+#include "glad/glad.h"
+#include "compute_shader.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+
+// In place exclusive prefix sum of the uints of an SSBO. Blocks of 512 values
+// are scanned in shared memory, their totals are scanned the same way one level
+// up and added back, with as many levels as the capacity needs.
+//
+// The passes use SSBO binding points 0 and 1; callers rebind their own buffers
+// after a scan.
+class PrefixScan
+{
+public:
+    // capacity: largest count exclusive_scan() will be called with
+    PrefixScan(unsigned int capacity, const char* shader_path = "shaders/prefix_scan.comp");
+    ~PrefixScan();
+
+    void exclusive_scan(unsigned int buffer, unsigned int count);
+
+    // exclusive prefix sum on the CPU, to validate against
+    static std::vector<unsigned int> reference(const std::vector<unsigned int>& values);
+
+    static const unsigned int BLOCK_SIZE = 512;
+
+private:
+    void scan_level(unsigned int buffer, unsigned int count, size_t level);
+
+    ComputeShader scan_shader;
+    ComputeShader add_shader;
+    unsigned int capacity;
+    // block_sums[l] holds the totals of the blocks of level l, level 0 being the scanned buffer
+    std::vector<unsigned int> block_sums;
+};
+
+
+PrefixScan::PrefixScan(unsigned int capacity, const char* shader_path) :
+    scan_shader(shader_path, "#define SCAN_BLOCKS"),
+    add_shader(shader_path, "#define SCAN_ADD"),
+    capacity(capacity)
+{
+    // the last level always holds the single total of the top block
+    size_t size = std::max(capacity, 1u);
+    do
+    {
+        size = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        unsigned int buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, size * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+        this->block_sums.push_back(buffer);
+    } while (size > 1);
+}
+
+
+PrefixScan::~PrefixScan()
+{
+    glDeleteBuffers(this->block_sums.size(), this->block_sums.data());
+    glDeleteProgram(this->scan_shader.ID);
+    glDeleteProgram(this->add_shader.ID);
+}
+
+
+void PrefixScan::scan_level(unsigned int buffer, unsigned int count, size_t level)
+{
+    unsigned int blocks = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, this->block_sums[level]);
+    this->scan_shader.use();
+    this->scan_shader.set_int("count", count);
+    glDispatchCompute(blocks, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    if (blocks > 1)
+    {
+        this->scan_level(this->block_sums[level], blocks, level + 1);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, this->block_sums[level]);
+        this->add_shader.use();
+        this->add_shader.set_int("count", count);
+        glDispatchCompute(blocks, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+}
+
+
+void PrefixScan::exclusive_scan(unsigned int buffer, unsigned int count)
+{
+    if (count == 0)
+        return;
+    if (count > this->capacity)
+    {
+        std::cout << "ERROR::PREFIX_SCAN: " << count << " values but the capacity is " << this->capacity << std::endl;
+        return;
+    }
+    this->scan_level(buffer, count, 0);
+}
+
+
+std::vector<unsigned int> PrefixScan::reference(const std::vector<unsigned int>& values)
+{
+    std::vector<unsigned int> result(values.size());
+    unsigned int sum = 0;
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        result[i] = sum;
+        sum += values[i];
+    }
+    return result;
+}
+
+
+#endif
@@ -0,0 +1,262 @@
+#ifndef PRIMITIVES_H
+#define PRIMITIVES_H
+
+#include <array>
+#include <cstddef>
+
+
+// Primitive meshes generated at compile time. Every table below is a
+// constexpr std::array, so it is emitted straight into read-only data: no
+// runtime construction, no heap allocation. Vertices are interleaved as
+// position (xyz) + texture coords (st), the layout used by the samples.
+namespace primitives
+{
+
+const int VERTEX_STRIDE = 5;
+
+
+// compile time math
+// -----------------
+constexpr double PI = 3.14159265358979323846;
+
+constexpr double abs(double x)
+{
+    return x < 0.0 ? -x : x;
+}
+
+// sine by Taylor series after reducing x to [-pi, pi], accurate to double precision
+constexpr double sin(double x)
+{
+    while (x > PI)
+        x -= 2.0 * PI;
+    while (x < -PI)
+        x += 2.0 * PI;
+
+    double term = x;
+    double sum = x;
+    for (int n = 1; n < 20; n++)
+    {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double cos(double x)
+{
+    return sin(x + PI / 2.0);
+}
+
+
+// cube
+// ----
+// the 24 corners of the unit cube, 4 per face, with the texture coordinates
+// used by the learnopengl samples
+constexpr std::array<float, 24 * VERTEX_STRIDE> CUBE_VERTICES = {
+    // back
+    -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+     0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
+     0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
+    // front
+    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+     0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+     0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
+    -0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
+    // left
+    -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+    -0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+    // right
+     0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+     0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+     0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+     0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+    // bottom
+    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+     0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
+     0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+    // top
+    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
+     0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+     0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+    -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
+};
+
+// every face is the quad (0, 1, 2, 3) split as (0, 1, 2) (2, 3, 0)
+constexpr std::array<unsigned short, 36> make_cube_indices()
+{
+    std::array<unsigned short, 36> indices = {};
+    const unsigned short quad[6] = { 0, 1, 2, 2, 3, 0 };
+    for (int face = 0; face < 6; face++)
+        for (int k = 0; k < 6; k++)
+            indices[face * 6 + k] = face * 4 + quad[k];
+    return indices;
+}
+
+constexpr std::array<unsigned short, 36> CUBE_INDICES = make_cube_indices();
+
+/**
+ * @brief Expands an indexed mesh into a non-indexed triangle soup.
+ */
+template<std::size_t V, std::size_t I, typename Index>
+constexpr std::array<float, I * VERTEX_STRIDE> expand(
+    const std::array<float, V>& vertices, const std::array<Index, I>& indices)
+{
+    std::array<float, I * VERTEX_STRIDE> soup = {};
+    for (std::size_t i = 0; i < I; i++)
+        for (int k = 0; k < VERTEX_STRIDE; k++)
+            soup[i * VERTEX_STRIDE + k] = vertices[indices[i] * VERTEX_STRIDE + k];
+    return soup;
+}
+
+// the 36 vertex cube drawn with glDrawArrays(GL_TRIANGLES, 0, 36)
+constexpr std::array<float, 36 * VERTEX_STRIDE> CUBE = expand(CUBE_VERTICES, CUBE_INDICES);
+
+
+// quad
+// ----
+// fullscreen quad drawn with glDrawArrays(GL_TRIANGLE_STRIP, 0, 4)
+constexpr std::array<float, 4 * VERTEX_STRIDE> QUAD = {
+    // positions        // texture Coords
+    -1.0f,  1.0f, 0.0f, 0.0f, 1.0f,
+    -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
+     1.0f,  1.0f, 0.0f, 1.0f, 1.0f,
+     1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
+};
+
+
+// sphere
+// ------
+// UV sphere with the same vertex and index layout as sphere::build_sphere_vertex
+template<int Sectors, int Stacks>
+struct Sphere
+{
+    static constexpr std::size_t VERTEX_COUNT = (Sectors + 1) * (Stacks + 1);
+    static constexpr std::size_t INDEX_COUNT = Sectors * Stacks * 6;
+
+    std::array<float, VERTEX_COUNT * VERTEX_STRIDE> vertices;
+    std::array<unsigned short, INDEX_COUNT> indices;
+};
+
+template<int Sectors, int Stacks>
+constexpr Sphere<Sectors, Stacks> make_sphere(double r)
+{
+    static_assert((Sectors + 1) * (Stacks + 1) < 65536, "sphere too large for 16 bit indices");
+
+    Sphere<Sectors, Stacks> sphere = {};
+    std::size_t v = 0;
+    for (int i = 0; i <= Stacks; i++)
+    {
+        double stack_angle = PI / 2.0 - i * PI / Stacks;
+        double xy = r * cos(stack_angle);
+        double z = r * sin(stack_angle);
+
+        for (int j = 0; j <= Sectors; j++)
+        {
+            double sector_angle = j * 2.0 * PI / Sectors;
+            sphere.vertices[v++] = (float)(xy * cos(sector_angle));
+            sphere.vertices[v++] = (float)(xy * sin(sector_angle));
+            sphere.vertices[v++] = (float)z;
+            sphere.vertices[v++] = (float)j / Sectors;
+            sphere.vertices[v++] = (float)i / Stacks;
+        }
+    }
+
+    std::size_t n = 0;
+    for (int i = 0; i < Stacks; i++)
+    {
+        unsigned short k1 = i * (Sectors + 1);
+        unsigned short k2 = k1 + (Sectors + 1);
+        for (int j = 0; j < Sectors; j++, k1++, k2++)
+        {
+            sphere.indices[n++] = k1;
+            sphere.indices[n++] = k2;
+            sphere.indices[n++] = k1 + 1;
+            sphere.indices[n++] = k1 + 1;
+            sphere.indices[n++] = k2;
+            sphere.indices[n++] = k2 + 1;
+        }
+    }
+    return sphere;
+}
+
+// low poly sphere of radius 0.5, drawn with glDrawElements(GL_TRIANGLES, ..., GL_UNSIGNED_SHORT, 0)
+constexpr Sphere<12, 6> LOW_POLY_SPHERE = make_sphere<12, 6>(0.5);
+
+
+// compile time checks
+// -------------------
+namespace checks
+{
+
+constexpr bool cube_is_unit_cube()
+{
+    for (std::size_t v = 0; v < CUBE.size(); v += VERTEX_STRIDE)
+        for (int k = 0; k < 3; k++)
+            if (CUBE[v + k] != 0.5f && CUBE[v + k] != -0.5f)
+                return false;
+    return true;
+}
+
+// every triangle of the cube must lie on one face: one coordinate shared by its 3 vertices
+constexpr bool cube_triangles_are_planar()
+{
+    for (std::size_t t = 0; t < 12; t++)
+    {
+        bool planar = false;
+        for (int k = 0; k < 3; k++)
+        {
+            float a = CUBE[(3 * t) * VERTEX_STRIDE + k];
+            float b = CUBE[(3 * t + 1) * VERTEX_STRIDE + k];
+            float c = CUBE[(3 * t + 2) * VERTEX_STRIDE + k];
+            planar = planar || (a == b && b == c);
+        }
+        if (!planar)
+            return false;
+    }
+    return true;
+}
+
+template<typename S>
+constexpr bool sphere_has_radius(const S& sphere, double r)
+{
+    for (std::size_t v = 0; v < sphere.vertices.size(); v += VERTEX_STRIDE)
+    {
+        double x = sphere.vertices[v], y = sphere.vertices[v + 1], z = sphere.vertices[v + 2];
+        if (abs(x * x + y * y + z * z - r * r) > 1e-5)
+            return false;
+    }
+    return true;
+}
+
+template<typename S>
+constexpr bool indices_in_range(const S& sphere)
+{
+    for (std::size_t i = 0; i < sphere.indices.size(); i++)
+        if (sphere.indices[i] >= S::VERTEX_COUNT)
+            return false;
+    return true;
+}
+
+static_assert(abs(sin(PI / 6.0) - 0.5) < 1e-12, "constexpr sin is inaccurate");
+static_assert(abs(cos(PI / 3.0) - 0.5) < 1e-12, "constexpr cos is inaccurate");
+static_assert(abs(sin(7.0) - 0.6569865987187891) < 1e-12, "constexpr sin range reduction is wrong");
+static_assert(CUBE.size() == 36 * VERTEX_STRIDE, "cube must have 36 vertices");
+static_assert(cube_is_unit_cube(), "cube corners must be at +-0.5");
+static_assert(cube_triangles_are_planar(), "cube triangles must lie on the cube faces");
+static_assert(CUBE[2 * VERTEX_STRIDE + 3] == 1.0f && CUBE[2 * VERTEX_STRIDE + 4] == 1.0f,
+    "cube texture coordinates changed");
+static_assert(QUAD.size() == 4 * VERTEX_STRIDE, "quad must have 4 vertices");
+static_assert(sphere_has_radius(LOW_POLY_SPHERE, 0.5), "sphere vertices must lie on the sphere");
+static_assert(indices_in_range(LOW_POLY_SPHERE), "sphere indices out of range");
+
+}; // namespace checks
+
+
+}; // namespace primitives
+
+
+#endif
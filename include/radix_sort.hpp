@@ -0,0 +1,129 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include "glad/glad.h"
+#include "compute_shader.hpp"
+#include "prefix_scan.hpp"
+
+#include <iostream>
+#include <utility>
+
+
+// Stable GPU radix sort of (key, value) pairs of uints held in SSBOs, 4 bits per
+// pass. Each pass counts the digits of every block of 256 keys, scans the
+// counts with a PrefixScan and scatters the blocks to their offsets. Only the
+// low key_bits of the keys are sorted, so short keys such as 16 bit depths or
+// 20 bit Morton codes take fewer passes.
+//
+// The passes use SSBO binding points 0 to 4; callers rebind their own buffers
+// after a sort.
+class RadixSort
+{
+public:
+    // capacity: largest count sort() will be called with
+    RadixSort(unsigned int capacity, const char* shader_path = "shaders/radix_sort.comp");
+    ~RadixSort();
+
+    // sorts the first count pairs of the keys and values buffers in place
+    void sort(unsigned int keys, unsigned int values, unsigned int count, unsigned int key_bits = 32);
+
+    static const unsigned int BLOCK_SIZE = 256;
+    static const unsigned int RADIX_BITS = 4;
+    static const unsigned int RADIX = 16;
+
+private:
+    ComputeShader count_shader;
+    ComputeShader scatter_shader;
+    unsigned int capacity;
+    PrefixScan scan;
+    // digit counts of every block, digit major
+    unsigned int histogram;
+    unsigned int temp_keys, temp_values;
+};
+
+
+RadixSort::RadixSort(unsigned int capacity, const char* shader_path) :
+    count_shader(shader_path, "#define RADIX_COUNT"),
+    scatter_shader(shader_path, "#define RADIX_SCATTER"),
+    capacity(capacity),
+    scan(RADIX * ((capacity + BLOCK_SIZE - 1) / BLOCK_SIZE))
+{
+    glGenBuffers(1, &this->histogram);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->histogram);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t)RADIX * ((capacity + BLOCK_SIZE - 1) / BLOCK_SIZE) * sizeof(GLuint),
+        NULL, GL_DYNAMIC_COPY);
+
+    glGenBuffers(1, &this->temp_keys);
+    glGenBuffers(1, &this->temp_values);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->temp_keys);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t)capacity * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->temp_values);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t)capacity * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+}
+
+
+RadixSort::~RadixSort()
+{
+    glDeleteBuffers(1, &this->temp_keys);
+    glDeleteBuffers(1, &this->temp_values);
+    glDeleteBuffers(1, &this->histogram);
+    glDeleteProgram(this->count_shader.ID);
+    glDeleteProgram(this->scatter_shader.ID);
+}
+
+
+void RadixSort::sort(unsigned int keys, unsigned int values, unsigned int count, unsigned int key_bits)
+{
+    if (count == 0)
+        return;
+    if (count > this->capacity)
+    {
+        std::cout << "ERROR::RADIX_SORT: " << count << " keys but the capacity is " << this->capacity << std::endl;
+        return;
+    }
+
+    unsigned int blocks = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    unsigned int source[2] = { keys, values };
+    unsigned int target[2] = { this->temp_keys, this->temp_values };
+    for (unsigned int shift = 0; shift < key_bits; shift += RADIX_BITS)
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, source[0]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, this->histogram);
+        this->count_shader.use();
+        this->count_shader.set_int("count", count);
+        this->count_shader.set_int("shift", shift);
+        glDispatchCompute(blocks, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        this->scan.exclusive_scan(this->histogram, RADIX * blocks);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, source[0]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, source[1]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, target[0]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, target[1]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, this->histogram);
+        this->scatter_shader.use();
+        this->scatter_shader.set_int("count", count);
+        this->scatter_shader.set_int("shift", shift);
+        glDispatchCompute(blocks, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        std::swap(source[0], target[0]);
+        std::swap(source[1], target[1]);
+    }
+
+    // an odd number of passes leaves the result in the scratch buffers
+    if (source[0] != keys)
+    {
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        glBindBuffer(GL_COPY_READ_BUFFER, source[0]);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, keys);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (size_t)count * sizeof(GLuint));
+        glBindBuffer(GL_COPY_READ_BUFFER, source[1]);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, values);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (size_t)count * sizeof(GLuint));
+    }
+}
+
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef REDUCTION_H
+#define REDUCTION_H
+
+#include "glad/glad.h"
+#include "compute_shader.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+
+// Sum, minimum or maximum of the uints, ints or floats of an SSBO. Every work
+// group reduces a block of 512 values to one in shared memory, and the block
+// results are reduced the same way until a single value is left in result().
+// Float sums are added in a tree, not in order, so they differ from a
+// sequential sum by rounding.
+//
+// The passes use SSBO binding points 0 and 1; callers rebind their own buffers
+// after a reduction.
+class Reduction
+{
+public:
+    enum ValueType { UINT, INT, FLOAT };
+    enum Op { SUM, MIN, MAX };
+
+    // capacity: largest count reduce() will be called with
+    Reduction(unsigned int capacity, const char* shader_path = "shaders/reduce.comp");
+    ~Reduction();
+
+    // leaves the result at the start of result(), behind a shader storage barrier
+    void reduce(unsigned int buffer, unsigned int count, ValueType type, Op op);
+    // buffer of one value holding the last result, to be read by a shader
+    unsigned int result() const { return this->result_buffer; }
+    // copies the last result back to the CPU, waiting for the GPU; T must
+    // match the type reduced
+    template<typename T>
+    T read_result() const;
+
+    // the same reduction on the CPU, to validate against
+    template<typename T>
+    static T reference(const std::vector<T>& values, Op op);
+
+    static const unsigned int BLOCK_SIZE = 512;
+
+private:
+    ComputeShader& variant(ValueType type, Op op);
+
+    std::string shader_path;
+    unsigned int capacity;
+    // partials[l] holds the block results of pass l, the last pass writes result_buffer
+    std::vector<unsigned int> partials;
+    unsigned int result_buffer;
+    std::map<int, ComputeShader*> shaders;
+};
+
+
+Reduction::Reduction(unsigned int capacity, const char* shader_path) :
+    shader_path(shader_path), capacity(capacity)
+{
+    size_t size = std::max(capacity, 1u);
+    while (size > BLOCK_SIZE)
+    {
+        size = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        unsigned int buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, size * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+        this->partials.push_back(buffer);
+    }
+    glGenBuffers(1, &this->result_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->result_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+}
+
+
+Reduction::~Reduction()
+{
+    glDeleteBuffers(this->partials.size(), this->partials.data());
+    glDeleteBuffers(1, &this->result_buffer);
+    for (auto& entry : this->shaders)
+    {
+        glDeleteProgram(entry.second->ID);
+        delete entry.second;
+    }
+}
+
+
+void Reduction::reduce(unsigned int buffer, unsigned int count, ValueType type, Op op)
+{
+    if (count == 0)
+    {
+        std::cout << "ERROR::REDUCTION: no values to reduce" << std::endl;
+        return;
+    }
+    if (count > this->capacity)
+    {
+        std::cout << "ERROR::REDUCTION: " << count << " values but the capacity is " << this->capacity << std::endl;
+        return;
+    }
+
+    ComputeShader& shader = this->variant(type, op);
+    shader.use();
+    unsigned int input = buffer;
+    for (size_t level = 0; ; level++)
+    {
+        unsigned int blocks = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        unsigned int output = blocks == 1 ? this->result_buffer : this->partials[level];
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, input);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, output);
+        shader.set_int("count", count);
+        glDispatchCompute(blocks, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        if (blocks == 1)
+            break;
+        input = output;
+        count = blocks;
+    }
+}
+
+
+template<typename T>
+T Reduction::read_result() const
+{
+    T value;
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->result_buffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(T), &value);
+    return value;
+}
+
+
+template<typename T>
+T Reduction::reference(const std::vector<T>& values, Op op)
+{
+    T result = values.front();
+    for (size_t i = 1; i < values.size(); i++)
+    {
+        if (op == SUM)
+            result += values[i];
+        else if (op == MIN)
+            result = std::min(result, values[i]);
+        else
+            result = std::max(result, values[i]);
+    }
+    return result;
+}
+
+
+ComputeShader& Reduction::variant(ValueType type, Op op)
+{
+    int key = type * 3 + op;
+    auto found = this->shaders.find(key);
+    if (found != this->shaders.end())
+        return *found->second;
+
+    const char* types[] = { "#define VALUE_UINT\n", "#define VALUE_INT\n", "#define VALUE_FLOAT\n" };
+    const char* ops[] = { "#define REDUCE_SUM\n", "#define REDUCE_MIN\n", "#define REDUCE_MAX\n" };
+    ComputeShader* shader = new ComputeShader(this->shader_path.c_str(), std::string(types[type]) + ops[op]);
+    this->shaders[key] = shader;
+    return *shader;
+}
+
+
+#endif
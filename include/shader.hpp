@@ -2,6 +2,7 @@
 #define SHADER_H
 
 #include "glad/glad.h"
+#include "shader_source.hpp"
 #include <glm/glm.hpp>
 
 #include <string>
@@ -13,7 +14,11 @@
 class Shader
 {
 public:
-    Shader(const char* vertex_path, const char* shader_path);
+    // defines is inserted after the #version line of both stages, see insert_defines
+    Shader(const char* vertex_path, const char* shader_path, const std::string& defines = "");
+    // separate defines per stage, for declarations only one of them can use
+    Shader(const char* vertex_path, const char* shader_path,
+        const std::string& vertex_defines, const std::string& fragment_defines);
     ~Shader();
 
     unsigned int program_ID;
@@ -39,7 +44,14 @@ private:
 };
 
 
-Shader::Shader(const char* vertex_path, const char* shader_path)
+Shader::Shader(const char* vertex_path, const char* shader_path, const std::string& defines) :
+    Shader(vertex_path, shader_path, defines, defines)
+{
+}
+
+
+Shader::Shader(const char* vertex_path, const char* shader_path,
+    const std::string& vertex_defines, const std::string& fragment_defines)
 {
     // 1. retrieve the vertex/fragment source code from filePath
     std::string vertexCode;
@@ -74,6 +86,9 @@ Shader::Shader(const char* vertex_path, const char* shader_path)
         std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
     }
 
+    vertexCode = insert_defines(vertexCode, vertex_defines);
+    fragmentCode = insert_defines(fragmentCode, fragment_defines);
+
     const char* vShaderCode = vertexCode.c_str();
     const char * fShaderCode = fragmentCode.c_str();
     // 2. compile shaders
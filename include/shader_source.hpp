@@ -0,0 +1,35 @@
+#ifndef SHADER_SOURCE_H
+#define SHADER_SOURCE_H
+
+#include <algorithm>
+#include <string>
+
+
+/**
+ * @brief Inserts extra source (defines, generated declarations) right after the
+ * #version line of a shader. A #line directive keeps the compiler messages
+ * pointing at the lines of the original file.
+ *
+ * @param code
+ * @param defines
+ * @return std::string
+ */
+std::string insert_defines(const std::string& code, const std::string& defines)
+{
+    if (defines.empty())
+        return code;
+
+    size_t version = code.find("#version");
+    if (version == std::string::npos)
+        return defines + "\n" + code;
+    size_t line_end = code.find('\n', version);
+    if (line_end == std::string::npos)
+        return code + "\n" + defines + "\n";
+
+    size_t next_line = std::count(code.begin(), code.begin() + line_end + 1, '\n') + 1;
+    return code.substr(0, line_end + 1) + defines + "\n#line " + std::to_string(next_line) + "\n"
+        + code.substr(line_end + 1);
+}
+
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef SIMULATION_CLOCK_H
+#define SIMULATION_CLOCK_H
+
+#include <cstdint>
+
+
+// Fixed timestep clock: the simulation advances in steps of exactly
+// step_seconds, as many per rendered frame as the real time elapsed calls for.
+// The state after N steps no longer depends on the frame rate, so two runs
+// from the same start are identical.
+class SimulationClock
+{
+public:
+    SimulationClock(double step_seconds, uint64_t first_step = 0, int max_steps_per_frame = 8);
+
+    // steps to run for a frame that took frame_seconds of real time; with
+    // lockstep every frame runs exactly one step
+    int advance(double frame_seconds);
+    // to call after every step
+    void tick();
+    // simulation time of the next step
+    double time() const;
+
+    double step_seconds;
+    // index of the next step
+    uint64_t step;
+    // more steps than this in one frame are dropped, the simulation slows down
+    // instead of falling further behind every frame
+    int max_steps_per_frame;
+    bool lockstep;
+
+private:
+    double accumulator;
+};
+
+
+SimulationClock::SimulationClock(double step_seconds, uint64_t first_step, int max_steps_per_frame) :
+    step_seconds(step_seconds), step(first_step), max_steps_per_frame(max_steps_per_frame),
+    lockstep(false), accumulator(0.0)
+{
+}
+
+
+int SimulationClock::advance(double frame_seconds)
+{
+    if (this->lockstep)
+        return 1;
+
+    this->accumulator += frame_seconds;
+    int steps = (int)(this->accumulator / this->step_seconds);
+    this->accumulator -= steps * this->step_seconds;
+    if (steps > this->max_steps_per_frame)
+    {
+        steps = this->max_steps_per_frame;
+        this->accumulator = 0.0;
+    }
+    return steps;
+}
+
+
+void SimulationClock::tick()
+{
+    this->step++;
+}
+
+
+double SimulationClock::time() const
+{
+    return this->step * this->step_seconds;
+}
+
+
+#endif
@@ -0,0 +1,417 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include "glad/glad.h"
+#include "compute_shader.hpp"
+#include "prefix_scan.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+// Uniform grid for particle-particle interactions. The particles are counting
+// sorted by cell: every particle takes a rank in its cell with an atomic, the
+// cell counts are scanned into the first slot of every cell and each particle
+// is written to its slot. Building is O(N + cells), and a query only visits the
+// block of cells around a particle, so with the cell size set to the
+// interaction radius the whole pass stays O(N).
+//
+// Compute shaders get the query API from glsl():
+//     ivec3 first = grid_first_cell(p), last = grid_last_cell(p);
+//     for (int z = first.z; z <= last.z; z++)
+//         for (int y = first.y; y <= last.y; y++)
+//         {
+//             uvec2 slots = grid_row_slots(ivec3(first.x, y, z), last.x);
+//             for (uint s = slots.x; s < slots.y; s++)
+//                 ... grid_particle(s), grid_position(s)
+//         }
+// The positions of the grid are a copy taken when it was built, so a pass can
+// move its particles while it reads their neighbours.
+namespace spatial_grid
+{
+
+// Box split in cubic cells; positions outside the box fall in the border cells
+struct GridDesc
+{
+    float min[3];
+    float cell_size;
+    // 1 / cell_size, multiplied on both sides so the CPU and the GPU agree on every cell
+    float inv_cell_size;
+    int size[3];
+};
+
+
+/**
+ * @brief Grid covering the box from min to max with cells of cell_size. Flat
+ * boxes get a single layer of cells.
+ *
+ * @param min
+ * @param max
+ * @param cell_size at least the interaction radius
+ * @return GridDesc
+ */
+GridDesc make_grid(const float min[3], const float max[3], float cell_size)
+{
+    GridDesc desc;
+    desc.cell_size = cell_size;
+    desc.inv_cell_size = 1.0f / cell_size;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        desc.min[axis] = min[axis];
+        desc.size[axis] = std::max((int)std::ceil((max[axis] - min[axis]) * desc.inv_cell_size), 1);
+    }
+    return desc;
+}
+
+
+unsigned int cell_count(const GridDesc& desc)
+{
+    return (unsigned int)desc.size[0] * desc.size[1] * desc.size[2];
+}
+
+
+// same as grid_cell() in the shaders
+void cell_of(const GridDesc& desc, const float p[3], int cell[3])
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        // clamped before the conversion, far away positions do not fit an int
+        float c = std::floor((p[axis] - desc.min[axis]) * desc.inv_cell_size);
+        cell[axis] = (int)std::min(std::max(c, 0.0f), (float)(desc.size[axis] - 1));
+    }
+}
+
+
+unsigned int cell_index(const GridDesc& desc, const int cell[3])
+{
+    return (unsigned int)((cell[2] * desc.size[1] + cell[1]) * desc.size[0] + cell[0]);
+}
+
+
+// Particles sorted by cell: the particles of cell c are particles[cell_start[c]]
+// to particles[cell_start[c + 1] - 1]
+struct CpuGrid
+{
+    std::vector<unsigned int> cell_start;
+    std::vector<unsigned int> particles;
+};
+
+
+// position i of an array with dims floats per particle, the missing coordinates are 0
+void load_position(const float* positions, int dims, size_t i, float p[3])
+{
+    for (int axis = 0; axis < 3; axis++)
+        p[axis] = axis < dims ? positions[i * dims + axis] : 0.0f;
+}
+
+
+/**
+ * @brief CPU reference of SpatialGrid::build(), the same counting sort. The
+ * particles of a cell keep their index order, where the GPU order depends on
+ * its atomics.
+ *
+ * @param desc
+ * @param positions dims floats per particle
+ * @param dims 2 for xy positions, 4 for xyzw
+ * @param count
+ * @param grid
+ */
+void build_cpu(const GridDesc& desc, const float* positions, int dims, size_t count, CpuGrid& grid)
+{
+    unsigned int cells = cell_count(desc);
+    grid.cell_start.assign(cells + 1, 0);
+    grid.particles.resize(count);
+
+    std::vector<unsigned int> particle_cells(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        float p[3];
+        int cell[3];
+        load_position(positions, dims, i, p);
+        cell_of(desc, p, cell);
+        particle_cells[i] = cell_index(desc, cell);
+        grid.cell_start[particle_cells[i]]++;
+    }
+
+    unsigned int sum = 0;
+    for (unsigned int c = 0; c <= cells; c++)
+    {
+        unsigned int cell_size = grid.cell_start[c];
+        grid.cell_start[c] = sum;
+        sum += cell_size;
+    }
+
+    std::vector<unsigned int> next(grid.cell_start.begin(), grid.cell_start.end() - 1);
+    for (size_t i = 0; i < count; i++)
+        grid.particles[next[particle_cells[i]]++] = i;
+}
+
+
+/**
+ * @brief CPU version of the query loop: calls fn(j) for every particle j in
+ * the block of cells around p, which holds every particle closer than the
+ * cell size. fn has to check the distance itself.
+ *
+ * @param desc
+ * @param grid
+ * @param p
+ * @param fn
+ */
+template <typename Fn>
+void for_each_neighbour(const GridDesc& desc, const CpuGrid& grid, const float p[3], Fn fn)
+{
+    int cell[3];
+    cell_of(desc, p, cell);
+    int first[3], last[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        first[axis] = std::max(cell[axis] - 1, 0);
+        last[axis] = std::min(cell[axis] + 1, desc.size[axis] - 1);
+    }
+
+    for (int z = first[2]; z <= last[2]; z++)
+        for (int y = first[1]; y <= last[1]; y++)
+        {
+            // the cells of a row are consecutive, so are their particles
+            int row_first[3] = { first[0], y, z };
+            int row_last[3] = { last[0], y, z };
+            unsigned int begin = grid.cell_start[cell_index(desc, row_first)];
+            unsigned int end = grid.cell_start[cell_index(desc, row_last) + 1];
+            for (unsigned int s = begin; s < end; s++)
+                fn(grid.particles[s]);
+        }
+}
+
+
+/**
+ * @brief Number of cells whose start or whose set of particles differ between
+ * two grids, e.g. a GPU grid read back and the CPU reference.
+ *
+ * @param a
+ * @param b
+ * @return size_t
+ */
+size_t count_mismatches(const CpuGrid& a, const CpuGrid& b)
+{
+    if (a.cell_start.size() != b.cell_start.size() || a.particles.size() != b.particles.size())
+        return std::max(a.cell_start.size(), b.cell_start.size());
+
+    size_t mismatches = 0;
+    for (size_t c = 0; c + 1 < a.cell_start.size(); c++)
+    {
+        if (a.cell_start[c] != b.cell_start[c] || a.cell_start[c + 1] != b.cell_start[c + 1])
+        {
+            mismatches++;
+            continue;
+        }
+        std::vector<unsigned int> cell_a(a.particles.begin() + a.cell_start[c], a.particles.begin() + a.cell_start[c + 1]);
+        std::vector<unsigned int> cell_b(b.particles.begin() + b.cell_start[c], b.particles.begin() + b.cell_start[c + 1]);
+        std::sort(cell_a.begin(), cell_a.end());
+        std::sort(cell_b.begin(), cell_b.end());
+        if (cell_a != cell_b)
+            mismatches++;
+    }
+    return mismatches;
+}
+
+
+// binding points of the grid buffers in the shaders that query it
+struct Bindings
+{
+    unsigned int cell_start;
+    unsigned int particles;
+    unsigned int positions;
+};
+
+
+// The grid on the GPU, rebuilt from a position SSBO with build()
+class SpatialGrid
+{
+public:
+    /**
+     * @param desc
+     * @param capacity largest particle count build() will be called with
+     * @param position_components 2 for vec2 positions, 4 for vec4
+     * @param bindings where bind() puts the grid for the query shaders
+     * @param shader_path
+     */
+    SpatialGrid(const GridDesc& desc, unsigned int capacity, int position_components,
+        Bindings bindings = { 3, 4, 5 }, const char* shader_path = "shaders/spatial_grid.comp");
+    ~SpatialGrid();
+
+    // sorts the first count particles of the positions buffer into the grid;
+    // uses SSBO binding points 0 to 5
+    void build(unsigned int positions, unsigned int count);
+    // binds the grid buffers to their query binding points
+    void bind() const;
+    // GLSL declarations of the grid buffers and the query functions
+    std::string glsl() const;
+    // copies the grid of the last build() of count particles back, for validation
+    void read_back(CpuGrid& grid, unsigned int count) const;
+
+    GridDesc desc;
+    unsigned int capacity;
+    int position_components;
+    Bindings bindings;
+
+private:
+    // grid constants and grid_cell(), shared by the build and the query shaders
+    std::string cell_glsl() const;
+
+    ComputeShader count_shader;
+    ComputeShader scatter_shader;
+    PrefixScan scan;
+    unsigned int cell_start, particle_cells, particle_ranks, grid_particles, grid_positions;
+};
+
+
+SpatialGrid::SpatialGrid(const GridDesc& desc, unsigned int capacity, int position_components,
+    Bindings bindings, const char* shader_path) :
+    desc(desc), capacity(capacity), position_components(position_components), bindings(bindings),
+    count_shader(shader_path, cell_glsl() + "#define POSITION_COMPONENTS " + std::to_string(position_components)
+        + "\n#define GRID_COUNT"),
+    scatter_shader(shader_path, cell_glsl() + "#define POSITION_COMPONENTS " + std::to_string(position_components)
+        + "\n#define GRID_SCATTER"),
+    scan(cell_count(desc) + 1)
+{
+    unsigned int* buffers[5] = { &this->cell_start, &this->particle_cells, &this->particle_ranks,
+        &this->grid_particles, &this->grid_positions };
+    size_t sizes[5] = {
+        (cell_count(desc) + 1) * sizeof(GLuint),
+        (size_t)capacity * sizeof(GLuint),
+        (size_t)capacity * sizeof(GLuint),
+        (size_t)capacity * sizeof(GLuint),
+        (size_t)capacity * 4 * sizeof(float),
+    };
+    for (int i = 0; i < 5; i++)
+    {
+        glGenBuffers(1, buffers[i]);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizes[i], NULL, GL_DYNAMIC_COPY);
+    }
+}
+
+
+SpatialGrid::~SpatialGrid()
+{
+    glDeleteBuffers(1, &this->cell_start);
+    glDeleteBuffers(1, &this->particle_cells);
+    glDeleteBuffers(1, &this->particle_ranks);
+    glDeleteBuffers(1, &this->grid_particles);
+    glDeleteBuffers(1, &this->grid_positions);
+    glDeleteProgram(this->count_shader.ID);
+    glDeleteProgram(this->scatter_shader.ID);
+}
+
+
+void SpatialGrid::build(unsigned int positions, unsigned int count)
+{
+    if (count > this->capacity)
+    {
+        std::cout << "ERROR::SPATIAL_GRID: " << count << " particles but the capacity is " << this->capacity << std::endl;
+        return;
+    }
+
+    // the counts include one extra cell so the scan leaves the end of the last cell behind it
+    GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->cell_start);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positions);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, this->cell_start);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, this->particle_cells);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, this->particle_ranks);
+    this->count_shader.use();
+    this->count_shader.set_int("count", count);
+    glDispatchCompute((count + 255) / 256, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    this->scan.exclusive_scan(this->cell_start, cell_count(this->desc) + 1);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positions);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, this->cell_start);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, this->particle_cells);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, this->particle_ranks);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, this->grid_particles);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, this->grid_positions);
+    this->scatter_shader.use();
+    this->scatter_shader.set_int("count", count);
+    glDispatchCompute((count + 255) / 256, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+
+void SpatialGrid::bind() const
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, this->bindings.cell_start, this->cell_start);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, this->bindings.particles, this->grid_particles);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, this->bindings.positions, this->grid_positions);
+}
+
+
+std::string SpatialGrid::cell_glsl() const
+{
+    // 9 digits bring the floats back exactly, so the CPU and the GPU use the same constants
+    std::ostringstream glsl;
+    glsl << std::setprecision(9)
+         << "// spatial grid generated by spatial_grid::SpatialGrid\n"
+         << "const vec3 gridMin = vec3(" << this->desc.min[0] << ", " << this->desc.min[1] << ", " << this->desc.min[2] << ");\n"
+         << "const float gridCellSize = " << this->desc.cell_size << ";\n"
+         << "const float gridInvCellSize = " << this->desc.inv_cell_size << ";\n"
+         << "const ivec3 gridSize = ivec3(" << this->desc.size[0] << ", " << this->desc.size[1] << ", " << this->desc.size[2] << ");\n"
+         << "ivec3 grid_cell(vec3 p)\n{\n"
+         << "    return ivec3(clamp(floor((p - gridMin) * gridInvCellSize), vec3(0.0), vec3(gridSize - 1)));\n}\n"
+         << "uint grid_cell_index(ivec3 cell)\n{\n"
+         << "    return uint((cell.z * gridSize.y + cell.y) * gridSize.x + cell.x);\n}\n";
+    return glsl.str();
+}
+
+
+std::string SpatialGrid::glsl() const
+{
+    std::ostringstream glsl;
+    glsl << this->cell_glsl()
+         << "layout(std430, binding = " << this->bindings.cell_start << ") readonly buffer gridCellStartBuffer\n{\n"
+         << "    uint gridCellStart[];\n};\n"
+         << "layout(std430, binding = " << this->bindings.particles << ") readonly buffer gridParticleBuffer\n{\n"
+         << "    uint gridParticles[];\n};\n"
+         << "layout(std430, binding = " << this->bindings.positions << ") readonly buffer gridPositionBuffer\n{\n"
+         << "    vec4 gridPositions[];\n};\n"
+         // the block of cells around p holds every particle closer than gridCellSize
+         << "ivec3 grid_first_cell(vec3 p)\n{\n"
+         << "    return max(grid_cell(p) - 1, ivec3(0));\n}\n"
+         << "ivec3 grid_last_cell(vec3 p)\n{\n"
+         << "    return min(grid_cell(p) + 1, gridSize - 1);\n}\n"
+         // the cells of a row are consecutive, so are the slots of their particles
+         << "uvec2 grid_row_slots(ivec3 first, int lastX)\n{\n"
+         << "    return uvec2(gridCellStart[grid_cell_index(first)],\n"
+         << "        gridCellStart[grid_cell_index(ivec3(lastX, first.yz)) + 1]);\n}\n"
+         << "uint grid_particle(uint slot)\n{\n"
+         << "    return gridParticles[slot];\n}\n"
+         << "vec3 grid_position(uint slot)\n{\n"
+         << "    return gridPositions[slot].xyz;\n}\n";
+    return glsl.str();
+}
+
+
+void SpatialGrid::read_back(CpuGrid& grid, unsigned int count) const
+{
+    grid.cell_start.resize(cell_count(this->desc) + 1);
+    grid.particles.resize(count);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, this->cell_start);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, grid.cell_start.size() * sizeof(GLuint), grid.cell_start.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, this->grid_particles);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, grid.particles.size() * sizeof(GLuint), grid.particles.data());
+}
+
+
+}; // namespace spatial_grid
+
+
+#endif
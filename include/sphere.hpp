@@ -0,0 +1,250 @@
+#ifndef SPHERE_H
+#define SPHERE_H
+
+#include "glad/glad.h"
+#include "camera.hpp"
+#include "mesh_optimizer.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+
+namespace sphere
+{
+
+// Vertex layout of every generated sphere: position (xyz) + texture coords (st)
+const int VERTEX_STRIDE = 5;
+
+// One level of detail inside a LODChain. All levels share the chain's
+// vertex/index buffers, so a level is drawn with
+// glDrawElementsBaseVertex(GL_TRIANGLES, index_count, ..., first_index, base_vertex)
+struct LOD
+{
+    int sector_count;
+    int stack_count;
+    unsigned int base_vertex;
+    unsigned int vertex_count;
+    unsigned int first_index;
+    unsigned int index_count;
+    // largest projected radius (in pixels) this level can be drawn at without
+    // its silhouette deviating from the true sphere by more than the pixel error
+    float max_radius_px;
+};
+
+// Several tessellations of the same sphere packed in a single buffer,
+// ordered from the finest (levels[0]) to the coarsest level.
+struct LODChain
+{
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<LOD> levels;
+};
+
+
+/**
+ * @brief Builds an UV sphere of radius r. Vertices are interleaved as
+ * (x, y, z, s, t) and indices describe a GL_TRIANGLES list.
+ * http://www.songho.ca/opengl/gl_sphere.html
+ *
+ * @param r
+ * @param sector_count number of longitude subdivisions
+ * @param stack_count number of latitude subdivisions
+ * @return std::pair<std::vector<float>, std::vector<unsigned int>>
+ */
+std::pair<std::vector<float>, std::vector<unsigned int>> build_sphere_vertex(
+    float r, int sector_count = 10, int stack_count = 10)
+{
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+
+    vertices.reserve((stack_count + 1) * (sector_count + 1) * VERTEX_STRIDE);
+    indices.reserve(stack_count * sector_count * 6);
+
+    float sector_step = glm::two_pi<double>() / sector_count;
+    float stack_step = glm::pi<double>() / stack_count;
+
+    for (int i = 0; i <= stack_count; i++)
+    {
+        float stack_angle = glm::half_pi<float>() - i * stack_step;
+
+        float xy = r * glm::cos(stack_angle);
+        float z = r * glm::sin(stack_angle);
+
+        for (int j = 0; j <= sector_count; j++)
+        {
+            float sector_angle = j * sector_step;
+
+            float x = xy * glm::cos(sector_angle);
+            float y = xy * glm::sin(sector_angle);
+
+            vertices.push_back(x);
+            vertices.push_back(y);
+            vertices.push_back(z);
+
+            float s = (float) j / sector_count;
+            float t = (float) i / stack_count;
+            vertices.push_back(s);
+            vertices.push_back(t);
+        }
+    }
+
+    // indices
+    for (int i = 0; i < stack_count; i++)
+    {
+        unsigned int k1 = i * (sector_count + 1);
+        unsigned int k2 = k1 + (sector_count + 1);
+
+        for (int j = 0; j < sector_count; j++, k1++, k2++)
+        {
+            indices.push_back(k1);
+            indices.push_back(k2);
+            indices.push_back(k1+1);
+
+            indices.push_back(k1+1);
+            indices.push_back(k2);
+            indices.push_back(k2+1);
+        }
+    }
+
+    return std::make_pair(vertices, indices);
+}
+
+
+/**
+ * @brief Returns the largest projected radius (pixels) at which a sphere with
+ * sector_count subdivisions stays within pixel_error of the real silhouette.
+ * The chord of a segment spanning angle a deviates from the arc by r * (1 - cos(a / 2)).
+ *
+ * @param sector_count
+ * @param pixel_error
+ * @return float
+ */
+float max_radius_px(int sector_count, float pixel_error)
+{
+    float sagitta = 1.0f - std::cos(glm::pi<float>() / sector_count);
+    return pixel_error / sagitta;
+}
+
+
+/**
+ * @brief Builds level_count UV spheres of radius r into one shared vertex/index
+ * buffer. Level 0 uses max_sectors subdivisions and every next level halves
+ * them, never going below min_sectors.
+ *
+ * @param r
+ * @param level_count
+ * @param max_sectors
+ * @param min_sectors
+ * @param pixel_error maximum silhouette error, in pixels, allowed for a level
+ * @param optimize run every level through mesh::optimize
+ * @return LODChain
+ */
+LODChain build_lod_chain(float r, int level_count = 5, int max_sectors = 64,
+    int min_sectors = 6, float pixel_error = 0.5f, bool optimize = true)
+{
+    LODChain chain;
+
+    int sectors = max_sectors;
+    for (int i = 0; i < level_count; i++)
+    {
+        int stacks = std::max(sectors / 2, 3);
+        auto level = build_sphere_vertex(r, sectors, stacks);
+        if (optimize)
+            mesh::optimize(level.first, level.second, VERTEX_STRIDE);
+
+        LOD lod;
+        lod.sector_count = sectors;
+        lod.stack_count = stacks;
+        lod.base_vertex = chain.vertices.size() / VERTEX_STRIDE;
+        lod.vertex_count = level.first.size() / VERTEX_STRIDE;
+        lod.first_index = chain.indices.size();
+        lod.index_count = level.second.size();
+        lod.max_radius_px = max_radius_px(sectors, pixel_error);
+        chain.levels.push_back(lod);
+
+        chain.vertices.insert(chain.vertices.end(), level.first.begin(), level.first.end());
+        chain.indices.insert(chain.indices.end(), level.second.begin(), level.second.end());
+
+        if (sectors == min_sectors)
+            break;
+        sectors = std::max(sectors / 2, min_sectors);
+    }
+
+    // the finest level has nothing better to fall back to
+    chain.levels[0].max_radius_px = std::numeric_limits<float>::max();
+    return chain;
+}
+
+
+/**
+ * @brief Radius, in pixels, of the sphere (center, radius) once projected by
+ * the camera onto a viewport viewport_height pixels tall. Returns infinity
+ * when the camera is inside the sphere.
+ *
+ * @param camera
+ * @param center
+ * @param radius
+ * @param viewport_height
+ * @return float
+ */
+float projected_radius(const cam::Camera& camera, const glm::vec3& center,
+    float radius, float viewport_height)
+{
+    glm::vec3 to_center = center - camera.get_position();
+    float dist2 = glm::dot(to_center, to_center);
+    if (dist2 <= radius * radius)
+        return std::numeric_limits<float>::infinity();
+
+    float half_fov = glm::radians(camera.get_fov()) * 0.5f;
+    // tangent distance instead of center distance keeps the estimate exact near the sphere
+    float tangent_dist = std::sqrt(dist2 - radius * radius);
+    return 0.5f * viewport_height * radius / (tangent_dist * std::tan(half_fov));
+}
+
+
+/**
+ * @brief Picks the coarsest level able to draw a sphere of radius_px pixels.
+ * current is the level the sphere was drawn with last frame (-1 if none):
+ * refining happens as soon as the current level is not good enough, while
+ * coarsening only happens once radius_px drops hysteresis (as a fraction)
+ * below the coarser level threshold, so spheres sitting right at a threshold
+ * do not pop back and forth every frame.
+ *
+ * @param chain
+ * @param radius_px
+ * @param current
+ * @param hysteresis
+ * @return int
+ */
+int select_lod(const LODChain& chain, float radius_px, int current = -1, float hysteresis = 0.15f)
+{
+    int target = 0;
+    int coarse_target = 0;
+    for (int i = chain.levels.size() - 1; i >= 0; i--)
+    {
+        if (radius_px <= chain.levels[i].max_radius_px)
+        {
+            target = std::max(target, i);
+        }
+        if (radius_px <= chain.levels[i].max_radius_px * (1.0f - hysteresis))
+        {
+            coarse_target = std::max(coarse_target, i);
+        }
+    }
+
+    if (current < 0 || target < current)
+        return target;
+    if (coarse_target > current)
+        return coarse_target;
+    return current;
+}
+
+
+}; // namespace sphere
+
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef STREAM_COMPACTION_H
+#define STREAM_COMPACTION_H
+
+#include "glad/glad.h"
+#include "compute_shader.hpp"
+#include "prefix_scan.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+
+// Packs the uints of an SSBO whose flag is not 0 at the start of another one,
+// in their original order, e.g. the indices of the particles that survived
+// culling. The flags are turned into 0 and 1, scanned into the offset of every
+// kept value, and the kept values are scattered to their offsets. The number
+// kept stays on the GPU in count_buffer(), a single uint that can size an
+// indirect dispatch (IndirectDispatch::build with counter_index 0) or draw.
+//
+// The passes use SSBO binding points 0 to 4; callers rebind their own buffers
+// after a compaction.
+class StreamCompaction
+{
+public:
+    // capacity: largest count compact() will be called with
+    StreamCompaction(unsigned int capacity, const char* shader_path = "shaders/compact.comp");
+    ~StreamCompaction();
+
+    // values and flags hold count uints each, and may be the same buffer to keep
+    // the values that are not 0; output needs room for count uints. Leaves the
+    // output and the count behind a shader storage barrier
+    void compact(unsigned int values, unsigned int flags, unsigned int output, unsigned int count);
+    unsigned int count_buffer() const { return this->total; }
+    // copies the last count back to the CPU, waiting for the GPU
+    unsigned int read_count() const;
+
+    // the same compaction on the CPU, to validate against
+    static std::vector<unsigned int> reference(const std::vector<unsigned int>& values,
+        const std::vector<unsigned int>& flags);
+
+    static const unsigned int GROUP_SIZE = 256;
+
+private:
+    ComputeShader flags_shader;
+    ComputeShader scatter_shader;
+    PrefixScan scan;
+    unsigned int capacity;
+    unsigned int offsets;
+    unsigned int total;
+};
+
+
+StreamCompaction::StreamCompaction(unsigned int capacity, const char* shader_path) :
+    flags_shader(shader_path, "#define COMPACT_FLAGS\n"),
+    scatter_shader(shader_path, "#define COMPACT_SCATTER\n"),
+    scan(capacity),
+    capacity(capacity)
+{
+    glGenBuffers(1, &this->offsets);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->offsets);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(capacity, 1u) * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    GLuint zero = 0;
+    glGenBuffers(1, &this->total);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->total);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), &zero, GL_DYNAMIC_COPY);
+}
+
+
+StreamCompaction::~StreamCompaction()
+{
+    glDeleteBuffers(1, &this->offsets);
+    glDeleteBuffers(1, &this->total);
+    glDeleteProgram(this->flags_shader.ID);
+    glDeleteProgram(this->scatter_shader.ID);
+}
+
+
+void StreamCompaction::compact(unsigned int values, unsigned int flags, unsigned int output, unsigned int count)
+{
+    if (count > this->capacity)
+    {
+        std::cout << "ERROR::STREAM_COMPACTION: " << count << " values but the capacity is " << this->capacity
+            << std::endl;
+        return;
+    }
+    if (count == 0)
+    {
+        GLuint zero = 0;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->total);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+        return;
+    }
+    unsigned int groups = (count + GROUP_SIZE - 1) / GROUP_SIZE;
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, flags);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, this->offsets);
+    this->flags_shader.use();
+    this->flags_shader.set_int("count", count);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    this->scan.exclusive_scan(this->offsets, count);
+
+    // the scan used bindings 0 and 1
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, values);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, flags);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, this->offsets);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, output);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, this->total);
+    this->scatter_shader.use();
+    this->scatter_shader.set_int("count", count);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+
+unsigned int StreamCompaction::read_count() const
+{
+    GLuint count;
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->total);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &count);
+    return count;
+}
+
+
+std::vector<unsigned int> StreamCompaction::reference(const std::vector<unsigned int>& values,
+    const std::vector<unsigned int>& flags)
+{
+    std::vector<unsigned int> result;
+    for (size_t i = 0; i < values.size(); i++)
+        if (flags[i] != 0)
+            result.push_back(values[i]);
+    return result;
+}
+
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Fixed set of worker threads running parallel_for jobs. The calling thread
+// takes part in every job, so a pool of 1 thread runs everything inline.
+class ThreadPool
+{
+public:
+    // thread_count == 0 uses every hardware thread
+    ThreadPool(unsigned int thread_count = 0);
+    ~ThreadPool();
+
+    unsigned int size() const;
+    // calls fn(first, last) over [begin, end) split in chunks of at most grain
+    // items, and returns once every chunk is done
+    void parallel_for(size_t begin, size_t end, size_t grain,
+        const std::function<void(size_t, size_t)>& fn);
+
+private:
+    void worker_loop();
+    void run_chunks();
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    // current job
+    const std::function<void(size_t, size_t)>* job;
+    size_t job_end;
+    size_t job_grain;
+    std::atomic<size_t> next_chunk;
+    unsigned int busy;
+    unsigned long generation;
+    bool stopping;
+};
+
+
+ThreadPool::ThreadPool(unsigned int thread_count) :
+    job(nullptr), job_end(0), job_grain(1), next_chunk(0), busy(0), generation(0), stopping(false)
+{
+    if (thread_count == 0)
+        thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned int i = 1; i < thread_count; i++)
+        this->workers.emplace_back(&ThreadPool::worker_loop, this);
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->wake.notify_all();
+    for (std::thread& worker : this->workers)
+        worker.join();
+}
+
+
+unsigned int ThreadPool::size() const
+{
+    return this->workers.size() + 1;
+}
+
+
+void ThreadPool::parallel_for(size_t begin, size_t end, size_t grain,
+    const std::function<void(size_t, size_t)>& fn)
+{
+    if (begin >= end)
+        return;
+    grain = std::max<size_t>(grain, 1);
+
+    if (this->workers.empty() || end - begin <= grain)
+    {
+        for (size_t first = begin; first < end; first += grain)
+            fn(first, std::min(first + grain, end));
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->job = &fn;
+        this->job_end = end;
+        this->job_grain = grain;
+        this->next_chunk = begin;
+        this->busy = this->workers.size();
+        this->generation++;
+    }
+    this->wake.notify_all();
+
+    this->run_chunks();
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->done.wait(lock, [this]() { return this->busy == 0; });
+    this->job = nullptr;
+}
+
+
+void ThreadPool::run_chunks()
+{
+    while (true)
+    {
+        size_t first = this->next_chunk.fetch_add(this->job_grain);
+        if (first >= this->job_end)
+            break;
+        (*this->job)(first, std::min(first + this->job_grain, this->job_end));
+    }
+}
+
+
+void ThreadPool::worker_loop()
+{
+    unsigned long seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->wake.wait(lock, [&]() { return this->stopping || this->generation != seen; });
+            if (this->stopping)
+                return;
+            seen = this->generation;
+        }
+
+        this->run_chunks();
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->busy--;
+        }
+        this->done.notify_one();
+    }
+}
+
+
+#endif
@@ -0,0 +1,256 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include "glad/glad.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+
+namespace vertex
+{
+
+// Storage used for the positions of a packed (position xyz + texture coords st) vertex.
+// Texture coordinates are stored as unorm16 by every format except FLOAT32.
+enum PositionFormat {
+    FLOAT32,    // 3 x float + 2 x float                  = 20 bytes
+    HALF_FLOAT, // 3 x half + padding + 2 x unorm16       = 12 bytes
+    SNORM16     // 3 x snorm16 + padding + 2 x unorm16    = 12 bytes
+};
+
+// Packed vertices ready to be uploaded to a GL_ARRAY_BUFFER
+struct PackedVertices
+{
+    PositionFormat format;
+    std::vector<uint8_t> data;
+    unsigned int stride;
+    // snorm16 positions are stored divided by this factor; scale the model matrix by it
+    float position_scale;
+};
+
+// Index buffer ready to be uploaded to a GL_ELEMENT_ARRAY_BUFFER
+struct PackedIndices
+{
+    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    GLenum type;
+    unsigned int index_size;
+    std::vector<uint8_t> data;
+};
+
+
+/**
+ * @brief Converts a float to an IEEE 754 half float, rounding to nearest even.
+ *
+ * @param value
+ * @return uint16_t
+ */
+uint16_t float_to_half(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t abs_bits = bits & 0x7fffffff;
+
+    // NaN and infinity
+    if (abs_bits >= 0x7f800000)
+        return sign | 0x7c00 | (abs_bits > 0x7f800000 ? 0x200 : 0);
+    // overflow, rounds to infinity
+    if (abs_bits >= 0x477ff000)
+        return sign | 0x7c00;
+    // subnormal half or zero
+    if (abs_bits < 0x38800000)
+    {
+        if (abs_bits < 0x33000000)
+            return sign;
+        uint32_t exponent = abs_bits >> 23;
+        uint32_t mantissa = (abs_bits & 0x7fffff) | 0x800000;
+        uint32_t shift = 126 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1)))
+            half++;
+        return sign | half;
+    }
+
+    // normal half: rebias the exponent and round the mantissa to 10 bits
+    uint32_t half = (abs_bits - 0x38000000) >> 13;
+    uint32_t remainder = abs_bits & 0x1fff;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+        half++;
+    return sign | half;
+}
+
+
+/**
+ * @brief Converts an IEEE 754 half float back to a float.
+ *
+ * @param half
+ * @return float
+ */
+float half_to_float(uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+
+    float value;
+    if (exponent == 0)
+        value = std::ldexp((float)mantissa, -24);
+    else if (exponent == 31)
+        value = mantissa ? NAN : INFINITY;
+    else
+        value = std::ldexp((float)(mantissa | 0x400), (int)exponent - 25);
+
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    bits |= sign;
+    std::memcpy(&value, &bits, sizeof(bits));
+    return value;
+}
+
+
+// Quantizes a value in [-1, 1] the way OpenGL expects normalized signed shorts
+int16_t quantize_snorm16(float value)
+{
+    value = std::min(std::max(value, -1.0f), 1.0f);
+    return (int16_t)std::lround(value * 32767.0f);
+}
+
+
+// Quantizes a value in [0, 1] the way OpenGL expects normalized unsigned shorts
+uint16_t quantize_unorm16(float value)
+{
+    value = std::min(std::max(value, 0.0f), 1.0f);
+    return (uint16_t)std::lround(value * 65535.0f);
+}
+
+
+/**
+ * @brief Packs interleaved (x, y, z, s, t) float vertices into the given format.
+ *
+ * @param vertices
+ * @param format
+ * @return PackedVertices
+ */
+PackedVertices pack_vertices(const std::vector<float>& vertices, PositionFormat format)
+{
+    const int float_stride = 5;
+    size_t vertex_count = vertices.size() / float_stride;
+
+    PackedVertices packed;
+    packed.format = format;
+    packed.position_scale = 1.0f;
+
+    if (format == FLOAT32)
+    {
+        packed.stride = float_stride * sizeof(float);
+        packed.data.resize(vertices.size() * sizeof(float));
+        std::memcpy(packed.data.data(), vertices.data(), packed.data.size());
+        return packed;
+    }
+
+    // positions are padded to 4 components so texture coordinates stay 4 byte aligned
+    packed.stride = 4 * sizeof(uint16_t) + 2 * sizeof(uint16_t);
+    packed.data.resize(vertex_count * packed.stride);
+
+    if (format == SNORM16)
+    {
+        float bound = 0.0f;
+        for (size_t v = 0; v < vertex_count; v++)
+            for (int k = 0; k < 3; k++)
+                bound = std::max(bound, std::abs(vertices[v * float_stride + k]));
+        packed.position_scale = bound > 0.0f ? bound : 1.0f;
+    }
+
+    for (size_t v = 0; v < vertex_count; v++)
+    {
+        const float* src = &vertices[v * float_stride];
+        uint16_t dst[6];
+        for (int k = 0; k < 3; k++)
+        {
+            if (format == HALF_FLOAT)
+                dst[k] = float_to_half(src[k]);
+            else
+                dst[k] = (uint16_t)quantize_snorm16(src[k] / packed.position_scale);
+        }
+        dst[3] = 0;
+        dst[4] = quantize_unorm16(src[3]);
+        dst[5] = quantize_unorm16(src[4]);
+        std::memcpy(&packed.data[v * packed.stride], dst, sizeof(dst));
+    }
+
+    return packed;
+}
+
+
+/**
+ * @brief Configures attribute 0 (position) and 1 (texture coords) of the bound
+ * VAO for vertices packed with pack_vertices. Normalized integer attributes are
+ * converted back to floats by the vertex fetch, shaders need no changes.
+ *
+ * @param packed
+ */
+void setup_attributes(const PackedVertices& packed)
+{
+    if (packed.format == FLOAT32)
+    {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, packed.stride, (void*)0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, packed.stride, (void*)(3 * sizeof(float)));
+    }
+    else
+    {
+        if (packed.format == HALF_FLOAT)
+            glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, packed.stride, (void*)0);
+        else
+            glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, packed.stride, (void*)0);
+        glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, packed.stride, (void*)(4 * sizeof(uint16_t)));
+    }
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+}
+
+
+/**
+ * @brief Packs the indices with the narrowest type able to address vertex_count
+ * vertices: GL_UNSIGNED_SHORT below 65536 vertices, GL_UNSIGNED_INT otherwise.
+ * When drawing with a base vertex, vertex_count is the largest vertex count of
+ * a single draw, not the size of the whole buffer.
+ *
+ * @param indices
+ * @param vertex_count
+ * @return PackedIndices
+ */
+PackedIndices pack_indices(const std::vector<unsigned int>& indices, size_t vertex_count)
+{
+    PackedIndices packed;
+    if (vertex_count < 65536)
+    {
+        packed.type = GL_UNSIGNED_SHORT;
+        packed.index_size = sizeof(uint16_t);
+        packed.data.resize(indices.size() * sizeof(uint16_t));
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            uint16_t index = (uint16_t)indices[i];
+            std::memcpy(&packed.data[i * sizeof(uint16_t)], &index, sizeof(uint16_t));
+        }
+    }
+    else
+    {
+        packed.type = GL_UNSIGNED_INT;
+        packed.index_size = sizeof(uint32_t);
+        packed.data.resize(indices.size() * sizeof(uint32_t));
+        std::memcpy(packed.data.data(), indices.data(), packed.data.size());
+    }
+    return packed;
+}
+
+
+}; // namespace vertex
+
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef WORKGROUP_TUNER_H
+#define WORKGROUP_TUNER_H
+
+#include "glad/glad.h"
+#include "compute_shader.hpp"
+#include "gpu_timer.hpp"
+
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+// Work group shape of a compute shader. Shaders that can be tuned declare
+//     layout(local_size_x = LOCAL_SIZE_X, local_size_y = LOCAL_SIZE_Y, local_size_z = LOCAL_SIZE_Z) in;
+// with defaults for the three defines, and bounds check their invocations since
+// the grid is rounded up to whole groups.
+struct LocalSize
+{
+    int x, y, z;
+
+    int invocations() const { return this->x * this->y * this->z; }
+};
+
+
+// Picks the fastest local size of a shader on this GPU by compiling one variant
+// per candidate and timing it with GL_TIME_ELAPSED queries. Results are kept in
+// a text cache keyed by the GL vendor, renderer and version strings, so tuning
+// runs once per device and driver; delete the file to tune again.
+class WorkgroupTuner
+{
+public:
+    // runs the shader once, with the uniforms and buffers it needs
+    typedef std::function<void(ComputeShader&, const LocalSize&)> Dispatch;
+
+    WorkgroupTuner(const std::string& cache_path = "workgroup_sizes.txt");
+
+    /**
+     * @brief Best local size for key on this device, from the cache or tuned now.
+     *
+     * @param key names the shader, variant and problem size being tuned
+     * @param shader_path
+     * @param defines defines of the variant, the LOCAL_SIZE_* ones are added
+     * @param candidates local sizes to try, those over the device limits are skipped
+     * @param dispatch
+     * @param repetitions dispatches timed per candidate
+     * @return the fastest candidate, or the first one if none could be timed
+     */
+    LocalSize tune(const std::string& key, const char* shader_path, const std::string& defines,
+        const std::vector<LocalSize>& candidates, const Dispatch& dispatch, int repetitions = 20);
+
+    // "#define LOCAL_SIZE_X x" and so on
+    static std::string glsl(const LocalSize& size);
+    // groups of size covering count invocations along one axis
+    static unsigned int groups(unsigned int count, int size);
+    // 1D shapes from 32 to 1024
+    static std::vector<LocalSize> candidates_1d();
+    // 2D shapes of 32 to 1024 invocations, by row width then height
+    static std::vector<LocalSize> candidates_2d();
+
+    std::string device;
+
+private:
+    bool fits(const LocalSize& size) const;
+    void save() const;
+
+    std::string cache_path;
+    std::map<std::string, LocalSize> cache;
+    int max_size[3];
+    int max_invocations;
+};
+
+
+WorkgroupTuner::WorkgroupTuner(const std::string& cache_path) :
+    cache_path(cache_path)
+{
+    this->device = std::string((const char*)glGetString(GL_VENDOR)) + " | "
+        + (const char*)glGetString(GL_RENDERER) + " | " + (const char*)glGetString(GL_VERSION);
+    for (int i = 0; i < 3; i++)
+        glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, i, &this->max_size[i]);
+    glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &this->max_invocations);
+
+    // one entry per line: device \t key \t x y z; other devices are kept as they are
+    std::ifstream file(cache_path);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        std::string device, key, size;
+        if (!std::getline(fields, device, '\t') || !std::getline(fields, key, '\t') || !std::getline(fields, size))
+            continue;
+        LocalSize local;
+        if (std::istringstream(size) >> local.x >> local.y >> local.z)
+            this->cache[device + '\t' + key] = local;
+    }
+}
+
+
+LocalSize WorkgroupTuner::tune(const std::string& key, const char* shader_path, const std::string& defines,
+    const std::vector<LocalSize>& candidates, const Dispatch& dispatch, int repetitions)
+{
+    auto cached = this->cache.find(this->device + '\t' + key);
+    if (cached != this->cache.end())
+        return cached->second;
+
+    std::cout << "tuning " << key << " on " << this->device << std::endl;
+    GpuTimer timer;
+    LocalSize best = candidates.front();
+    double bestMs = -1.0;
+    for (const LocalSize& size : candidates)
+    {
+        if (!this->fits(size))
+            continue;
+        ComputeShader shader(shader_path, defines + glsl(size));
+        GLint linked;
+        glGetProgramiv(shader.ID, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            glDeleteProgram(shader.ID);
+            continue;
+        }
+
+        // the first dispatch of a program can pay for its upload
+        dispatch(shader, size);
+        timer.begin();
+        for (int i = 0; i < repetitions; i++)
+            dispatch(shader, size);
+        timer.end();
+        double ms = timer.elapsed_ms() / repetitions;
+        glDeleteProgram(shader.ID);
+
+        std::cout << "  " << size.x << "x" << size.y << "x" << size.z << ": " << ms << " ms" << std::endl;
+        if (bestMs < 0.0 || ms < bestMs)
+        {
+            best = size;
+            bestMs = ms;
+        }
+    }
+    if (bestMs < 0.0)
+    {
+        std::cout << "ERROR::WORKGROUP_TUNER::NO_CANDIDATE_RAN: " << key << std::endl;
+        return best;
+    }
+
+    std::cout << "  best: " << best.x << "x" << best.y << "x" << best.z << std::endl;
+    this->cache[this->device + '\t' + key] = best;
+    this->save();
+    return best;
+}
+
+
+std::string WorkgroupTuner::glsl(const LocalSize& size)
+{
+    return "#define LOCAL_SIZE_X " + std::to_string(size.x) + "\n"
+        + "#define LOCAL_SIZE_Y " + std::to_string(size.y) + "\n"
+        + "#define LOCAL_SIZE_Z " + std::to_string(size.z) + "\n";
+}
+
+
+unsigned int WorkgroupTuner::groups(unsigned int count, int size)
+{
+    return (count + size - 1) / size;
+}
+
+
+std::vector<LocalSize> WorkgroupTuner::candidates_1d()
+{
+    return { { 32, 1, 1 }, { 64, 1, 1 }, { 128, 1, 1 }, { 256, 1, 1 }, { 512, 1, 1 }, { 1024, 1, 1 } };
+}
+
+
+std::vector<LocalSize> WorkgroupTuner::candidates_2d()
+{
+    return { { 8, 4, 1 }, { 8, 8, 1 }, { 16, 4, 1 }, { 16, 8, 1 }, { 16, 16, 1 }, { 32, 2, 1 }, { 32, 4, 1 },
+        { 32, 8, 1 }, { 32, 16, 1 }, { 32, 32, 1 }, { 64, 4, 1 } };
+}
+
+
+bool WorkgroupTuner::fits(const LocalSize& size) const
+{
+    return size.x <= this->max_size[0] && size.y <= this->max_size[1] && size.z <= this->max_size[2]
+        && size.invocations() <= this->max_invocations;
+}
+
+
+void WorkgroupTuner::save() const
+{
+    std::ofstream file(this->cache_path);
+    if (!file)
+    {
+        std::cout << "ERROR::WORKGROUP_TUNER::CANNOT_WRITE: " << this->cache_path << std::endl;
+        return;
+    }
+    for (const auto& entry : this->cache)
+        file << entry.first << '\t' << entry.second.x << ' ' << entry.second.y << ' ' << entry.second.z << '\n';
+}
+
+
+#endif
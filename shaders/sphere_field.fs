@@ -0,0 +1,13 @@
+#version 430 core
+out vec4 FragColor;
+
+in vec3 Normal;
+in vec3 Color;
+
+uniform vec3 lightDir;
+
+void main()
+{
+    float diffuse = max(dot(normalize(Normal), -lightDir), 0.0);
+    FragColor = vec4(Color * (0.2 + 0.8 * diffuse), 1.0);
+}
@@ -0,0 +1,39 @@
+#version 430 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+
+struct Sphere {
+    vec4 centerRadius;
+    vec4 color;
+};
+
+layout(std430, binding = 0) readonly buffer sphereBuffer
+{
+    Sphere spheres[];
+};
+
+// indices of the spheres that survived culling, filled by sphere_cull.comp
+layout(std430, binding = 1) readonly buffer visibleBuffer
+{
+    uint visible[];
+};
+
+uniform mat4 view;
+uniform mat4 projection;
+// the mesh is an unit sphere stored divided by this factor
+uniform float meshScale;
+uniform bool culled;
+
+out vec3 Normal;
+out vec3 Color;
+
+void main()
+{
+    uint id = culled ? visible[gl_InstanceID] : uint(gl_InstanceID);
+    Sphere sphere = spheres[id];
+
+    vec3 local = aPos * meshScale;
+    Normal = local;
+    Color = sphere.color.rgb;
+    gl_Position = projection * view * vec4(sphere.centerRadius.xyz + local * sphere.centerRadius.w, 1.0);
+}
@@ -0,0 +1,51 @@
+#version 430 core
+out vec4 FragColor;
+// the hit is never nearer than the quad (sphere_impostor.vs), so early depth
+// tests against the quad stay valid while the exact depth is written
+layout(depth_greater) out float gl_FragDepth;
+
+in vec3 ViewPos;
+flat in vec4 ViewSphere;
+flat in vec3 Color;
+
+uniform mat4 projection;
+// light direction in view space
+uniform vec3 lightDir;
+
+void main()
+{
+    // ray from the eye (view space origin) through the fragment against the sphere
+    vec3 rayDir = normalize(ViewPos);
+    vec3 center = ViewSphere.xyz;
+    float radius = ViewSphere.w;
+
+    float b = dot(rayDir, center);
+    float c = dot(center, center) - radius * radius;
+    float discriminant = b * b - c;
+    if (discriminant < 0.0)
+        discard;
+
+    // the near root is behind the eye when the eye is inside the sphere (c < 0)
+    // and may be in front of the near plane when the sphere crosses it; the far
+    // root, the inside of the sphere, is what shows then. Spheres behind the eye
+    // have both roots negative
+    float root = sqrt(discriminant);
+    float t = b - root;
+    vec4 clip = projection * vec4(rayDir * t, 1.0);
+    bool inside = t <= 0.0 || clip.z < -clip.w;
+    if (inside)
+    {
+        t = b + root;
+        clip = projection * vec4(rayDir * t, 1.0);
+        if (t <= 0.0 || clip.z < -clip.w)
+            discard;
+    }
+    vec3 hit = rayDir * t;
+    vec3 normal = (inside ? center - hit : hit - center) / radius;
+
+    // write the depth of the hit point so impostors intersect like real spheres
+    gl_FragDepth = 0.5 * (clip.z / clip.w) + 0.5;
+
+    float diffuse = max(dot(normal, -lightDir), 0.0);
+    FragColor = vec4(Color * (0.2 + 0.8 * diffuse), 1.0);
+}
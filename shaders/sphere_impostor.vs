@@ -0,0 +1,66 @@
+#version 430 core
+// corners of primitives::QUAD, the texture coords are not needed
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoords;
+
+struct Sphere {
+    vec4 centerRadius;
+    vec4 color;
+};
+
+layout(std430, binding = 0) readonly buffer sphereBuffer
+{
+    Sphere spheres[];
+};
+
+// indices of the spheres that survived culling, filled by sphere_cull.comp
+layout(std430, binding = 1) readonly buffer visibleBuffer
+{
+    uint visible[];
+};
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform bool culled;
+
+out vec3 ViewPos;
+flat out vec4 ViewSphere;
+flat out vec3 Color;
+
+void main()
+{
+    uint id = culled ? visible[gl_InstanceID] : uint(gl_InstanceID);
+    Sphere sphere = spheres[id];
+
+    vec3 center = (view * vec4(sphere.centerRadius.xyz, 1.0)).xyz;
+    float radius = sphere.centerRadius.w;
+
+    // distance to the near plane, from the perspective projection
+    float near = projection[3][2] / (projection[2][2] - 1.0);
+    float dist = length(center);
+    if (dist - radius < near)
+    {
+        // the sphere reaches the near plane or holds the eye: cover the screen
+        // on the near plane, every hit lies behind it
+        gl_Position = vec4(aPos.xy, -0.999, 1.0);
+        vec4 eye = inverse(projection) * gl_Position;
+        ViewPos = eye.xyz / eye.w;
+    }
+    else
+    {
+        // the quad lies in the plane touching the front of the sphere, facing the
+        // eye, sized to the cross section of the cone tangent to the sphere so it
+        // covers the whole silhouette; no point of the sphere is nearer, which
+        // the fragment shader relies on for conservative depth
+        vec3 dir = center / dist;
+        vec3 right = normalize(cross(dir, abs(dir.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));
+        vec3 up = cross(right, dir);
+        float front = dist - radius;
+        float halfSize = radius * front / sqrt(dist * dist - radius * radius);
+
+        ViewPos = front * dir + (aPos.x * right + aPos.y * up) * halfSize;
+        gl_Position = projection * vec4(ViewPos, 1.0);
+    }
+    ViewSphere = vec4(center, radius);
+    Color = sphere.color.rgb;
+}
@@ -1,6 +1,10 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "include/stb_image.h"
 #include "include/shader.hpp"
+#include "include/camera.hpp"
+#include "include/sphere.hpp"
+#include "include/mesh_optimizer.hpp"
+#include "include/vertex_format.hpp"
 #include "include/glad/glad.h"
 
 
@@ -10,80 +14,37 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void mouse_callback(GLFWwindow* window, double xpos, double ypos);
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+// spheres are laid out in a GRID_SIZE x GRID_SIZE grid
+const int GRID_SIZE = 64;
+const float GRID_SPACING = 1.5f;
+// storage of the sphere positions, FLOAT32 keeps the original 20 byte vertices
+const vertex::PositionFormat POSITION_FORMAT = vertex::SNORM16;
 
-//http://www.songho.ca/opengl/gl_sphere.html
-std::pair<std::vector<float>, std::vector<unsigned int>> build_sphere_vertex(float r)
-{
-    std::vector<float> vertices;
-    std::vector<unsigned int> indices;
-
-    int sector_count = 10;
-    int stack_count = 10;
-    float sector_step = glm::two_pi<double>() / sector_count;
-    float stack_step = glm::pi<double>() / stack_count;
-
-    for (int i = 0; i <= stack_count; i++)
-    {
-        float stack_angle = glm::half_pi<float>() - i * stack_step;
-
-        float xy = r * glm::cos(stack_angle);
-        float z = r * glm::sin(stack_angle);
-
-        for (int j = 0; j <= sector_count; j++)
-        {
-            float sector_angle = j * sector_step;
-
-            float x = xy * glm::cos(sector_angle);
-            float y = xy * glm::sin(sector_angle);
+// mouse
+float lastX = SCR_WIDTH / 2;
+float lastY = SCR_HEIGHT / 2;
+bool firstMouse = true;
 
-            vertices.push_back(x);
-            vertices.push_back(y);
-            vertices.push_back(z);
+// camera variables
+cam::Camera camera(glm::vec3(0.0f, 2.0f, 3.0f));
+float viewportHeight = SCR_HEIGHT;
 
-            float s = (float) j / sector_count;
-            float t = (float) i / sector_count;
-            vertices.push_back(s);
-            vertices.push_back(t);
-        }
-    }
-
-    // indices
-    for (int i = 0; i < stack_count; i++)
-    {
-        unsigned int k1 = i * (sector_count + 1);
-        unsigned int k2 = k1 + (sector_count + 1);
-
-        for (int j = 0; j < sector_count; j++, k1++, k2++)
-        {
-            //if (i != 0)
-            {
-                indices.push_back(k1);
-                indices.push_back(k2);
-                indices.push_back(k1+1);
-            }
-            //if (i != (stack_count - 1))
-            {
-                indices.push_back(k1+1);
-                indices.push_back(k2);
-                indices.push_back(k2+1);
-            }
-            
-        }
-        
-    }
-    
-    return std::make_pair(vertices, indices);
-}
+// time variables
+float deltaTime = 0;
+float lastFrame = 0; // time of the last frame
 
 
 int main()
@@ -110,6 +71,10 @@ int main()
     }
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetCursorPosCallback(window, mouse_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     // glad: load all OpenGL function pointers
     // ---------------------------------------
@@ -129,9 +94,32 @@ int main()
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
-    auto sphere = build_sphere_vertex(0.5);
-    std::vector<float> vertices = sphere.first;
-    std::vector<unsigned int> indices = sphere.second;
+    // every level of detail lives in the same VBO/EBO, so switching LOD is
+    // only a matter of changing the draw offsets
+    sphere::LODChain lodChain = sphere::build_lod_chain(0.5);
+    std::vector<float>& vertices = lodChain.vertices;
+    std::vector<unsigned int>& indices = lodChain.indices;
+
+    // compare every level against the plain stack/sector ordering
+    for (size_t i = 0; i < lodChain.levels.size(); i++)
+    {
+        const sphere::LOD& lod = lodChain.levels[i];
+        auto unoptimized = sphere::build_sphere_vertex(0.5, lod.sector_count, lod.stack_count);
+        std::vector<unsigned int> levelIndices(indices.begin() + lod.first_index,
+            indices.begin() + lod.first_index + lod.index_count);
+
+        mesh::report("LOD " + std::to_string(i) + " (" + std::to_string(lod.sector_count) + "x"
+                + std::to_string(lod.stack_count) + ")",
+            mesh::analyze_vertex_cache(unoptimized.second, unoptimized.first.size() / sphere::VERTEX_STRIDE),
+            mesh::analyze_vertex_cache(levelIndices, lod.vertex_count));
+    }
+
+    std::vector<glm::vec3> spherePositions;
+    for (int i = 0; i < GRID_SIZE; i++)
+        for (int j = 0; j < GRID_SIZE; j++)
+            spherePositions.push_back(glm::vec3(i * GRID_SPACING, 0.0f, -j * GRID_SPACING));
+    // LOD each sphere was drawn with on the previous frame, used for hysteresis
+    std::vector<int> sphereLODs(spherePositions.size(), -1);
 
 
     unsigned int VBO, VAO, EBO;
@@ -141,18 +129,26 @@ int main()
 
     glBindVertexArray(VAO);
 
+    // quantize the vertices and pick the narrowest index type. Every LOD is drawn
+    // with its own base vertex, so only the largest level has to fit in 16 bits
+    vertex::PackedVertices packedVertices = vertex::pack_vertices(vertices, POSITION_FORMAT);
+    size_t maxLevelVertices = 0;
+    for (const sphere::LOD& lod : lodChain.levels)
+        maxLevelVertices = std::max(maxLevelVertices, (size_t)lod.vertex_count);
+    vertex::PackedIndices packedIndices = vertex::pack_indices(indices, maxLevelVertices);
+
+    std::cout << "vertex buffer: " << vertices.size() * sizeof(float) << " -> " << packedVertices.data.size()
+        << " bytes, index buffer: " << indices.size() * sizeof(unsigned int) << " -> "
+        << packedIndices.data.size() << " bytes" << std::endl;
+
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, packedVertices.data.size(), packedVertices.data.data(), GL_STATIC_DRAW);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, packedIndices.data.size(), packedIndices.data.data(), GL_STATIC_DRAW);
 
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    // texture coord attribute
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    // position and texture coord attributes
+    vertex::setup_attributes(packedVertices);
 
 
     // load and create a texture 
@@ -192,8 +188,13 @@ int main()
 
     // render loop
     // -----------
+    int fCounter = 0;
     while (!glfwWindowShouldClose(window))
     {
+        float currentFrame = glfwGetTime();
+        deltaTime = currentFrame - lastFrame;
+        lastFrame = currentFrame;
+
         // input
         // -----
         processInput(window);
@@ -211,20 +212,44 @@ int main()
         ourShader.use();
 
         // create transformations
-        glm::mat4 model         = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
-        glm::mat4 view          = glm::mat4(1.0f);
-        glm::mat4 projection    = glm::mat4(1.0f);
-        model = glm::rotate(model, (float)glfwGetTime(), glm::vec3(0.5f, 1.0f, 0.0f));
-        view  = glm::translate(view, glm::vec3(0.0f, 0.0f, -3.0f));
-        projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        glm::mat4 view = camera.get_view_matrix();
+        glm::mat4 projection = glm::perspective(
+            glm::radians(camera.get_fov()), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 200.0f);
 
         ourShader.set_mat4("view", view);
-        ourShader.set_mat4("model", model);
         ourShader.set_mat4("projection", projection);
 
-        // render container
+        // render spheres, each with the LOD matching its size on screen
+        std::vector<int> lodHistogram(lodChain.levels.size(), 0);
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        for (size_t i = 0; i < spherePositions.size(); i++)
+        {
+            float radiusPx = sphere::projected_radius(camera, spherePositions[i], 0.5f, viewportHeight);
+            sphereLODs[i] = sphere::select_lod(lodChain, radiusPx, sphereLODs[i]);
+            const sphere::LOD& lod = lodChain.levels[sphereLODs[i]];
+            lodHistogram[sphereLODs[i]]++;
+
+            glm::mat4 model = glm::mat4(1.0f);
+            model = glm::translate(model, spherePositions[i]);
+            model = glm::scale(model, glm::vec3(packedVertices.position_scale));
+            ourShader.set_mat4("model", model);
+
+            glDrawElementsBaseVertex(GL_TRIANGLES, lod.index_count, packedIndices.type,
+                (void*)((size_t)lod.first_index * packedIndices.index_size), lod.base_vertex);
+        }
+
+        if (fCounter > 500)
+        {
+            std::cout << "FPS: " << 1 / deltaTime << " | spheres per LOD:";
+            for (size_t i = 0; i < lodHistogram.size(); i++)
+                std::cout << " " << lodHistogram[i];
+            std::cout << std::endl;
+            fCounter = 0;
+        }
+        else
+        {
+            fCounter++;
+        }
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
@@ -250,6 +275,39 @@ void processInput(GLFWwindow *window)
 {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
+
+    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+        camera.move(cam::Movement::FORWARD, deltaTime);
+    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+        camera.move(cam::Movement::BACKWARD, deltaTime);
+    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+        camera.move(cam::Movement::LEFT, deltaTime);
+    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+        camera.move(cam::Movement::RIGHT, deltaTime);
+}
+
+
+void mouse_callback(GLFWwindow* window, double xpos, double ypos)
+{
+    if (firstMouse)
+    {
+        lastX = xpos;
+        lastY = ypos;
+        firstMouse = false;
+    }
+
+    float x_offset = (xpos - lastX);
+    float y_offset = (lastY - ypos); // reversed due to coordinate system
+    lastX = xpos;
+    lastY = ypos;
+
+    camera.rotate(x_offset, y_offset, true);
+}
+
+
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+    camera.zoom(yoffset);
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -259,4 +317,5 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     // make sure the viewport matches the new window dimensions; note that width and 
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
+    viewportHeight = height;
 }
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "include/sphere.hpp"
+#include "include/mesh_optimizer.hpp"
+#include "include/parametric.hpp"
+#include "include/primitives.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+
+// Microbenchmark of sphere::build_sphere_vertex against the table driven
+// parametric::build_sphere, single and multi threaded, after checking the mesh
+// optimizer on meshes whose results are known. Exits with 1 if a check failed.
+
+// number of runs of every measurement, the fastest one is reported
+const int RUNS = 5;
+
+
+double time_ms(const std::function<void()>& fn)
+{
+    double best = 1e30;
+    for (int run = 0; run < RUNS; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+
+float max_difference(const parametric::Mesh& a, const parametric::Mesh& b)
+{
+    if (a.first.size() != b.first.size() || a.second != b.second)
+        return INFINITY;
+    float diff = 0.0f;
+    for (size_t i = 0; i < a.first.size(); i++)
+        diff = std::max(diff, std::abs(a.first[i] - b.first[i]));
+    return diff;
+}
+
+
+/**
+ * @brief Welds meshes with duplicated seam vertices and checks the vertex
+ * counts, then checks that mesh::optimize does not raise the ACMR of a sphere.
+ *
+ * @return true if every check passed
+ */
+bool check_mesh_optimizer()
+{
+    bool ok = true;
+    auto check = [&](const std::string& name, bool passed) {
+        std::cout << "    " << name << (passed ? ": ok" : ": FAILED") << std::endl;
+        ok = ok && passed;
+    };
+    std::cout << "mesh optimizer checks" << std::endl;
+
+    // the 36 corners of the cube triangle soup, copies of a corner 0.9 epsilon
+    // apart; sliding the cube over two epsilon puts them on both sides of a
+    // cell boundary of any grid of up to that size for some of the shifts
+    const float epsilon = 1e-6f;
+    bool cubeWelds = true;
+    for (int shift = 0; shift < 8; shift++)
+    {
+        std::vector<float> cube;
+        for (size_t v = 0; v < primitives::CUBE.size() / primitives::VERTEX_STRIDE; v++)
+            for (int k = 0; k < 3; k++)
+                cube.push_back(primitives::CUBE[v * primitives::VERTEX_STRIDE + k]
+                    + (0.25f * shift + (v % 2 ? 0.45f : -0.45f)) * epsilon);
+        auto welded = mesh::weld_vertices(cube, {}, 3, epsilon);
+        cubeWelds = cubeWelds && welded.first.size() / 3 == 8 && welded.second.size() == 36;
+    }
+    check("cube welds to 8 vertices", cubeWelds);
+
+    // positions only: the seam column and the pole rings collapse
+    const int sectors = 36, stacks = 18;
+    auto sphereMesh = sphere::build_sphere_vertex(0.5f, sectors, stacks);
+    std::vector<float> positions;
+    for (size_t v = 0; v < sphereMesh.first.size() / sphere::VERTEX_STRIDE; v++)
+        for (int k = 0; k < 3; k++)
+            positions.push_back(sphereMesh.first[v * sphere::VERTEX_STRIDE + k]);
+    auto sphereWelded = mesh::weld_vertices(positions, sphereMesh.second, 3, 1e-5f);
+    check("sphere welds to " + std::to_string(sectors * (stacks - 1) + 2) + " vertices",
+        sphereWelded.first.size() / 3 == (size_t)(sectors * (stacks - 1) + 2));
+
+    mesh::CacheStats before = mesh::analyze_vertex_cache(sphereMesh.second, positions.size() / 3);
+    std::vector<float> optimizedVertices = sphereMesh.first;
+    std::vector<unsigned int> optimizedIndices = sphereMesh.second;
+    mesh::optimize(optimizedVertices, optimizedIndices, sphere::VERTEX_STRIDE);
+    mesh::CacheStats after = mesh::analyze_vertex_cache(optimizedIndices,
+        optimizedVertices.size() / sphere::VERTEX_STRIDE);
+    check("ACMR " + std::to_string(before.acmr) + " -> " + std::to_string(after.acmr), after.acmr <= before.acmr);
+    return ok;
+}
+
+
+int main()
+{
+    bool ok = check_mesh_optimizer();
+
+    unsigned int threads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::cout << "threads: " << threads << std::endl;
+
+    for (int target : { 10000, 100000, 1000000 })
+    {
+        // sectors = 2 * stacks, as in sphere::build_lod_chain
+        int stacks = (int)std::sqrt(target / 2.0);
+        int sectors = 2 * stacks;
+        size_t vertex_count = (size_t)(stacks + 1) * (sectors + 1);
+
+        parametric::Mesh reference, simd, threaded;
+        double scalar_ms = time_ms([&]() { reference = sphere::build_sphere_vertex(0.5f, sectors, stacks); });
+        double simd_ms = time_ms([&]() { simd = parametric::build_sphere(0.5f, sectors, stacks, 1); });
+        double threaded_ms = time_ms([&]() { threaded = parametric::build_sphere(0.5f, sectors, stacks, threads); });
+
+        std::cout << vertex_count << " vertices (" << sectors << "x" << stacks << ")" << std::endl;
+        std::cout << "    build_sphere_vertex      " << scalar_ms << " ms" << std::endl;
+        std::cout << "    parametric 1 thread      " << simd_ms << " ms (x" << scalar_ms / simd_ms << ")" << std::endl;
+        std::cout << "    parametric " << threads << " thread(s)   " << threaded_ms
+            << " ms (x" << scalar_ms / threaded_ms << ")" << std::endl;
+        std::cout << "    max difference " << std::max(max_difference(reference, simd),
+            max_difference(reference, threaded)) << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,536 @@
+#include "include/shader.hpp"
+#include "include/compute_shader.hpp"
+#include "include/camera.hpp"
+#include "include/sphere.hpp"
+#include "include/mesh_optimizer.hpp"
+#include "include/vertex_format.hpp"
+#include "include/gpu_timer.hpp"
+#include "include/primitives.hpp"
+#include "include/glad/glad.h"
+
+
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+// Draws N spheres stored in an instance SSBO with a single instanced draw call,
+// optionally culled against the view frustum on the GPU. Spheres are either
+// tessellated meshes or ray traced impostors: camera facing quads whose
+// fragment shader intersects the sphere analytically.
+//
+// usage: sphere_field.out [--count N] [--cull] [--impostor] [--bench]
+//     --count N    number of spheres (default 100000)
+//     --cull       frustum cull the spheres in a compute pass and draw indirect
+//     --impostor   draw impostors instead of meshes
+//     --bench      sweep N from 1k to 1M for every mode and print GPU times, once
+//                  with small spheres (vertex bound) and once with large ones (fill bound)
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void mouse_callback(GLFWwindow* window, double xpos, double ypos);
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void processInput(GLFWwindow *window);
+
+// settings
+const unsigned int SCR_WIDTH = 1280;
+const unsigned int SCR_HEIGHT = 720;
+// frames measured per benchmark configuration
+const int BENCH_WARMUP_FRAMES = 10;
+const int BENCH_FRAMES = 100;
+
+// mouse
+float lastX = SCR_WIDTH / 2;
+float lastY = SCR_HEIGHT / 2;
+bool firstMouse = true;
+
+// camera variables
+cam::Camera camera(glm::vec3(0.0f, 0.0f, 0.0f));
+
+// time variables
+float deltaTime = 0;
+float lastFrame = 0; // time of the last frame
+
+
+// std430 layout of the Sphere struct in the shaders
+struct SphereInstance
+{
+    glm::vec4 center_radius;
+    glm::vec4 color;
+};
+
+// std430 layout of DrawElementsIndirectCommand
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+};
+
+// DrawArraysIndirectCommand, padded to the size of DrawElementsIndirectCommand so
+// both can be bound to sphere_cull.comp, which only touches instance_count
+struct DrawArraysIndirectCommand
+{
+    GLuint count;
+    GLuint instance_count;
+    GLuint first;
+    GLuint base_instance;
+    GLuint padding;
+};
+
+enum SphereMode {
+    MESH,
+    IMPOSTOR
+};
+
+
+/**
+ * @brief Random spheres inside a cube whose side grows with the cube root of
+ * count, so the density of the field stays the same for every count.
+ */
+std::vector<SphereInstance> build_sphere_field(size_t count, float& extent, float radius_scale = 1.0f)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    extent = 2.0f * std::cbrt((float)count);
+    std::vector<SphereInstance> spheres(count);
+    for (SphereInstance& sphere : spheres)
+    {
+        glm::vec3 center(unit(rng), unit(rng), unit(rng));
+        center = (center * 2.0f - glm::vec3(1.0f)) * extent;
+        sphere.center_radius = glm::vec4(center, (0.2f + 0.3f * unit(rng)) * radius_scale);
+        sphere.color = glm::vec4(unit(rng), unit(rng), unit(rng), 1.0f);
+    }
+    return spheres;
+}
+
+
+/**
+ * @brief Frustum planes of the view-projection matrix m (Gribb/Hartmann), with
+ * normals pointing inside the frustum.
+ */
+void extract_frustum_planes(const glm::mat4& m, glm::vec4 planes[6])
+{
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+    planes[0] = rows[3] + rows[0]; // left
+    planes[1] = rows[3] - rows[0]; // right
+    planes[2] = rows[3] + rows[1]; // bottom
+    planes[3] = rows[3] - rows[1]; // top
+    planes[4] = rows[3] + rows[2]; // near
+    planes[5] = rows[3] - rows[2]; // far
+
+    for (int p = 0; p < 6; p++)
+        planes[p] = planes[p] / glm::length(glm::vec3(planes[p].x, planes[p].y, planes[p].z));
+}
+
+
+// Owns the sphere mesh and instance buffers and issues the instanced draw
+class SphereFieldRenderer
+{
+public:
+    SphereFieldRenderer();
+    ~SphereFieldRenderer();
+
+    void upload(const std::vector<SphereInstance>& spheres);
+    // draws every sphere with one instanced draw, or culls them first and
+    // draws the survivors with one indirect draw
+    void draw(const glm::mat4& view, const glm::mat4& projection, bool cull, SphereMode mode = MESH);
+
+private:
+    Shader shader;
+    Shader impostor_shader;
+    ComputeShader cull_shader;
+    unsigned int VAO, VBO, EBO;
+    unsigned int quadVAO, quadVBO;
+    unsigned int sphere_buffer, visible_buffer, command_buffer, quad_command_buffer;
+    vertex::PackedVertices packed_vertices;
+    vertex::PackedIndices packed_indices;
+    unsigned int index_count;
+    size_t sphere_count;
+};
+
+
+SphereFieldRenderer::SphereFieldRenderer() :
+    shader("shaders/sphere_field.vs", "shaders/sphere_field.fs"),
+    impostor_shader("shaders/sphere_impostor.vs", "shaders/sphere_impostor.fs"),
+    cull_shader("shaders/sphere_cull.comp"), sphere_count(0)
+{
+    // unit sphere, cache optimized and quantized
+    auto mesh = sphere::build_sphere_vertex(1.0f, 16, 8);
+    mesh::optimize(mesh.first, mesh.second, sphere::VERTEX_STRIDE);
+    this->packed_vertices = vertex::pack_vertices(mesh.first, vertex::SNORM16);
+    this->packed_indices = vertex::pack_indices(mesh.second, mesh.first.size() / sphere::VERTEX_STRIDE);
+    this->index_count = mesh.second.size();
+
+    glGenVertexArrays(1, &this->VAO);
+    glGenBuffers(1, &this->VBO);
+    glGenBuffers(1, &this->EBO);
+
+    glBindVertexArray(this->VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+    glBufferData(GL_ARRAY_BUFFER, this->packed_vertices.data.size(),
+        this->packed_vertices.data.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->packed_indices.data.size(),
+        this->packed_indices.data.data(), GL_STATIC_DRAW);
+    vertex::setup_attributes(this->packed_vertices);
+    glBindVertexArray(0);
+
+    // impostors reuse the quad layout of renderQuad
+    glGenVertexArrays(1, &this->quadVAO);
+    glGenBuffers(1, &this->quadVBO);
+    glBindVertexArray(this->quadVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, this->quadVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(primitives::QUAD), primitives::QUAD.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+    glBindVertexArray(0);
+
+    glGenBuffers(1, &this->sphere_buffer);
+    glGenBuffers(1, &this->visible_buffer);
+    glGenBuffers(1, &this->command_buffer);
+    glGenBuffers(1, &this->quad_command_buffer);
+
+    DrawElementsIndirectCommand command = { this->index_count, 0, 0, 0, 0 };
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->command_buffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(command), &command, GL_DYNAMIC_DRAW);
+
+    DrawArraysIndirectCommand quad_command = { 4, 0, 0, 0, 0 };
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->quad_command_buffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(quad_command), &quad_command, GL_DYNAMIC_DRAW);
+}
+
+
+SphereFieldRenderer::~SphereFieldRenderer()
+{
+    glDeleteVertexArrays(1, &this->VAO);
+    glDeleteBuffers(1, &this->VBO);
+    glDeleteBuffers(1, &this->EBO);
+    glDeleteVertexArrays(1, &this->quadVAO);
+    glDeleteBuffers(1, &this->quadVBO);
+    glDeleteBuffers(1, &this->quad_command_buffer);
+    glDeleteBuffers(1, &this->sphere_buffer);
+    glDeleteBuffers(1, &this->visible_buffer);
+    glDeleteBuffers(1, &this->command_buffer);
+}
+
+
+void SphereFieldRenderer::upload(const std::vector<SphereInstance>& spheres)
+{
+    this->sphere_count = spheres.size();
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->sphere_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, spheres.size() * sizeof(SphereInstance),
+        spheres.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->visible_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, spheres.size() * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+}
+
+
+void SphereFieldRenderer::draw(const glm::mat4& view, const glm::mat4& projection, bool cull, SphereMode mode)
+{
+    unsigned int command = mode == MESH ? this->command_buffer : this->quad_command_buffer;
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, this->sphere_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, this->visible_buffer);
+
+    if (cull)
+    {
+        glm::vec4 planes[6];
+        extract_frustum_planes(projection * view, planes);
+
+        // reset the instance count, the culling pass appends the visible spheres to it
+        GLuint zero = 0;
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, offsetof(DrawElementsIndirectCommand, instance_count),
+            sizeof(GLuint), &zero);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, command);
+
+        this->cull_shader.use();
+        for (int p = 0; p < 6; p++)
+            this->cull_shader.set_vec4("planes[" + std::to_string(p) + "]", planes[p]);
+        this->cull_shader.set_int("sphereCount", this->sphere_count);
+        glDispatchCompute((this->sphere_count + 255) / 256, 1, 1);
+
+        // the draw reads the command and the visible list written by the compute pass
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    glm::vec3 lightDir = glm::normalize(glm::vec3(-0.3f, -1.0f, -0.5f));
+
+    if (mode == MESH)
+    {
+        this->shader.use();
+        this->shader.set_mat4("view", view);
+        this->shader.set_mat4("projection", projection);
+        this->shader.set_float("meshScale", this->packed_vertices.position_scale);
+        this->shader.set_bool("culled", cull);
+        this->shader.set_vec3("lightDir", lightDir);
+
+        glBindVertexArray(this->VAO);
+        if (cull)
+            glDrawElementsIndirect(GL_TRIANGLES, this->packed_indices.type, (void*)0);
+        else
+            glDrawElementsInstanced(GL_TRIANGLES, this->index_count, this->packed_indices.type,
+                (void*)0, this->sphere_count);
+    }
+    else
+    {
+        // impostors are lit in view space
+        glm::vec4 viewLightDir = view * glm::vec4(lightDir, 0.0f);
+
+        this->impostor_shader.use();
+        this->impostor_shader.set_mat4("view", view);
+        this->impostor_shader.set_mat4("projection", projection);
+        this->impostor_shader.set_bool("culled", cull);
+        this->impostor_shader.set_vec3("lightDir", glm::vec3(viewLightDir.x, viewLightDir.y, viewLightDir.z));
+
+        glBindVertexArray(this->quadVAO);
+        if (cull)
+            glDrawArraysIndirect(GL_TRIANGLE_STRIP, (void*)0);
+        else
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, this->sphere_count);
+    }
+    glBindVertexArray(0);
+}
+
+
+/**
+ * @brief Draws BENCH_FRAMES frames and returns the average GPU time per frame.
+ * Every frame has its own timer of a small ring, read TIMER_LATENCY frames
+ * later once its result is in, so the CPU never waits for the GPU to drain.
+ */
+double benchmark(GLFWwindow* window, SphereFieldRenderer& renderer, const glm::mat4& view,
+    const glm::mat4& projection, bool cull, SphereMode mode)
+{
+    const int TIMER_LATENCY = 3;
+    GpuTimer timers[TIMER_LATENCY];
+    double total = 0.0;
+    const int frames = BENCH_WARMUP_FRAMES + BENCH_FRAMES;
+    for (int frame = 0; frame < frames + TIMER_LATENCY; frame++)
+    {
+        // the timer of this slot measured frame - TIMER_LATENCY, read it before reuse
+        GpuTimer& timer = timers[frame % TIMER_LATENCY];
+        int measured = frame - TIMER_LATENCY;
+        if (measured >= BENCH_WARMUP_FRAMES)
+            total += timer.elapsed_ms();
+        if (frame >= frames)
+            continue;
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        timer.begin();
+        renderer.draw(view, projection, cull, mode);
+        timer.end();
+
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
+    return total / BENCH_FRAMES;
+}
+
+
+int main(int argc, char* argv[])
+{
+    size_t sphereCount = 100000;
+    bool cull = false;
+    bool bench = false;
+    SphereMode mode = MESH;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--count" && i + 1 < argc)
+            sphereCount = std::stoul(argv[++i]);
+        else if (arg == "--cull")
+            cull = true;
+        else if (arg == "--impostor")
+            mode = IMPOSTOR;
+        else if (arg == "--bench")
+            bench = true;
+    }
+
+    // glfw: initialize and configure
+    // ------------------------------
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+    // glfw window creation
+    // --------------------
+    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+    if (window == NULL)
+    {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetCursorPosCallback(window, mouse_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+    glfwSwapInterval(0);
+
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+    // glad: load all OpenGL function pointers
+    // ---------------------------------------
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return -1;
+    }
+
+    // configure global opengl state
+    // -----------------------------
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+
+    // the renderer owns GL objects, it has to be gone before the context is destroyed
+    {
+        SphereFieldRenderer renderer;
+        float extent;
+
+        if (bench)
+        {
+            for (float radiusScale : { 1.0f, 8.0f })
+            {
+                std::cout << "radius x" << radiusScale << std::endl;
+                std::cout << "spheres\tmesh (ms)\tmesh culled\timpostor\timpostor culled" << std::endl;
+                for (size_t count : { 1000, 10000, 100000, 1000000 })
+                {
+                    renderer.upload(build_sphere_field(count, extent, radiusScale));
+
+                    // look into the field from one of its faces
+                    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, extent), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+                    glm::mat4 projection = glm::perspective(glm::radians(45.0f),
+                        (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 4.0f * extent);
+
+                    std::cout << count;
+                    for (SphereMode benchMode : { MESH, IMPOSTOR })
+                        for (bool benchCull : { false, true })
+                            std::cout << "\t" << benchmark(window, renderer, view, projection, benchCull, benchMode);
+                    std::cout << std::endl;
+                }
+            }
+        }
+        else
+        {
+            renderer.upload(build_sphere_field(sphereCount, extent));
+
+            // render loop
+            // -----------
+            int fCounter = 0;
+            while (!glfwWindowShouldClose(window))
+            {
+                float currentFrame = glfwGetTime();
+                deltaTime = currentFrame - lastFrame;
+                lastFrame = currentFrame;
+                if (fCounter > 500)
+                {
+                    std::cout << "FPS: " << 1 / deltaTime << std::endl;
+                    fCounter = 0;
+                }
+                else
+                {
+                    fCounter++;
+                }
+
+                // input
+                // -----
+                processInput(window);
+
+                // render
+                // ------
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+                glm::mat4 view = camera.get_view_matrix();
+                glm::mat4 projection = glm::perspective(glm::radians(camera.get_fov()),
+                    (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 4.0f * extent);
+                renderer.draw(view, projection, cull, mode);
+
+                // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+                // -------------------------------------------------------------------------------
+                glfwSwapBuffers(window);
+                glfwPollEvents();
+            }
+        }
+    }
+
+    // glfw: terminate, clearing all previously allocated GLFW resources.
+    // ------------------------------------------------------------------
+    glfwTerminate();
+    return 0;
+}
+
+// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
+// ---------------------------------------------------------------------------------------------------------
+void processInput(GLFWwindow *window)
+{
+    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+        glfwSetWindowShouldClose(window, true);
+
+    // the field is large, move faster than the default camera speed
+    float dt = 10.0f * deltaTime;
+    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+        camera.move(cam::Movement::FORWARD, dt);
+    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+        camera.move(cam::Movement::BACKWARD, dt);
+    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+        camera.move(cam::Movement::LEFT, dt);
+    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+        camera.move(cam::Movement::RIGHT, dt);
+}
+
+
+void mouse_callback(GLFWwindow* window, double xpos, double ypos)
+{
+    if (firstMouse)
+    {
+        lastX = xpos;
+        lastY = ypos;
+        firstMouse = false;
+    }
+
+    float x_offset = (xpos - lastX);
+    float y_offset = (lastY - ypos); // reversed due to coordinate system
+    lastX = xpos;
+    lastY = ypos;
+
+    camera.rotate(x_offset, y_offset, true);
+}
+
+
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+    camera.zoom(yoffset);
+}
+
+// glfw: whenever the window size changed (by OS or user resize) this callback function executes
+// ---------------------------------------------------------------------------------------------
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+    // make sure the viewport matches the new window dimensions; note that width and
+    // height will be significantly larger than specified on retina displays.
+    glViewport(0, 0, width, height);
+}